@@ -1,50 +1,247 @@
 #include <iostream>
-#include <time.h>
+#include <cstdio>
+#include <chrono>
+#include <string>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include "camera/framebuffer.hpp"
 #include "camera/camera.hpp"
 #include "geometry/geometry.hpp"
 #include "geometry/bvhnode.hpp"
+#include "geometry/environment.hpp"
 #include "material/material.hpp"
 #include "pdf/pdf.hpp"
 #include "gmm/gmm.hpp"
 #include "kdtree/kdTree.hpp"
+#include "parallel/tile.hpp"
+#include "scene/scene.hpp"
+#include "integrator/wavefront.hpp"
+#include "integrator/mis.hpp"
+#include "integrator/bdpt.hpp"
+#include "integrator/sppm.hpp"
+#include "integrator/irradiance_cache.hpp"
+#include "integrator/path_guide.hpp"
+#include "integrator/adaptive_rr.hpp"
+#include "integrator/restir.hpp"
+#include "integrator/pssmlt.hpp"
 
 using std::shared_ptr;
 using std::make_shared;
 using std::vector;
 
-class vertex
+/*
+    with a cache, the first diffuse vertex takes its indirect light from the irradiance cache and the
+    path ends there; the cache's gather rays are paths that start after a light sample, so they skip
+    the emission of their first hit (specularBounce = false)
+    with a guide, diffuse bounces sample its mixture or the BRDF, and record themselves while it trains
+    with an adaptive_rr past its pre-pass, every diffuse vertex asks it whether the path ends, goes on
+    or splits, in place of the fixed roulette; split branches wait on a stack and are traced after
+    the path, only the first records itself for a guide, with the light it found alone
+    first_t, when given, is the distance to the first hit, INF on a miss, left alone when depth is 0
+*/
+inline color MC_PT(const ray& camera_r, const BVHnode& world, const shared_ptr<geometry>& lights, int depth, thread_context& ctx,
+                   irradiance_cache* cache = nullptr, path_guide* guide = nullptr, adaptive_rr* arr = nullptr, bool specularBounce = true,
+                   double* first_t = nullptr)
 {
-public:
-    point p;
-    color beta;
-    double pA;
-    direction norm;
+    color L(0.0), beta(1.0);
+    ray r = camera_r;
+
+    guide_vertex verts[path_guide::max_vertices];
+    int nvert = 0;
+    rr_vertex rverts[adaptive_rr::max_vertices];
+    int nrvert = 0;
+
+    bool adaptive = arr && arr->ready() && ctx.pixel >= 0;
+    rr_branch pending[adaptive_rr::max_branches];
+    int npending = 0;
+    bool first = true;
+    color L_first(0.0);     // L when the first branch ended, all the recorded vertices lead to
+    
+    int i = 0;
+    for(;;)
+    {
+        for(; i < depth; ++i)
+        {
+            hit_record rec;
+            ctx.rays++;
+            bool found = world.hit(r, rec);
+            if(first_t && first && i == 0)
+                *first_t = found ? rec.t : INF;
+            if(!found)
+            {
+                if(specularBounce)
+                    L = L + beta * lights->environment(r.get_dir());
+                break;
+            }
+            
+            // sampled direction from the last vertex is from a specular BRDF, add emitted term
+            if(specularBounce)
+                L = L + beta * rec.hit_mat->emitted(rec.uv);
+
+            scatter_record srec;
+            if(!rec.hit_mat->scatter(r, rec, srec, *ctx.smp))
+                break;
+
+            if(srec.is_specular)
+            {
+                beta = beta * srec.attenuation;
+                r = srec.specular_ray;
+                specularBounce = true;
+                continue;
+            }
+
+            if(arr && arr->training() && nrvert < adaptive_rr::max_vertices)
+                rverts[nrvert++] = rr_vertex { rec.p, beta, L };
 
-    vertex() {}
-    vertex(const point& _p, const color& _b, double _pA, const direction& _n) : p(_p), beta(_b), pA(_pA), norm(_n) {}
-};
+            // sample light
+            geometry_pdf gp(rec.p, lights);
+            direction out = gp.generate(*ctx.smp);
+            double pdf_val = gp.value(out);
+            ray light_ray(rec.p, out);
 
-inline color MC_PT(const ray& camera_r, const BVHnode& world, const shared_ptr<geometry>& lights, int depth)
+            hit_record l_rec1, l_rec2;
+            ctx.rays++;
+            if(world.hit(light_ray, l_rec1))
+            {
+                if(lights->hit(light_ray, l_rec2) && (l_rec1.p - l_rec2.p).length_square() < EPS)
+                    L = L + beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray) * l_rec1.hit_mat->emitted(l_rec1.uv) / pdf_val;
+            }
+            else if(pdf_val > 0)
+                L = L + beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray) * lights->environment(out) / pdf_val;
+
+            // Lambertian, the outgoing radiance is albedo / pi times the irradiance
+            if(cache)
+            {
+                int rest = depth - i - 1;
+                color E = cache->irradiance(rec, ctx, [&](const ray& g, thread_context& c, double& t) {
+                    return MC_PT(g, world, lights, rest, c, nullptr, nullptr, nullptr, false, &t);
+                });
+                L = L + beta * srec.attenuation * E / PI;
+                break;
+            }
+
+            // roulette and splitting by the share of its pixel the path is expected to add
+            int split = 1;
+            if(adaptive)
+            {
+                split = arr->continuations(ctx.pixel, rec.p, beta, ctx.smp->get_1d(), adaptive_rr::max_branches - npending + 1);
+                if(split == 0)
+                    break;
+            }
+
+            // sample brdf, or the guide's mixture when this region has one
+            const pdf& bp = srec.brdf_pdf;
+            guide_pdf gm = guide ? guide->lookup(rec.p, rec.normal) : guide_pdf();
+            double frac = gm.valid() ? guide->fraction() : 0.0;
+            auto sample = [&]() { return frac > 0 && ctx.smp->get_1d() < frac ? gm.generate(*ctx.smp) : bp.generate(*ctx.smp); };
+            auto value = [&](const direction& o) { return frac > 0 ? frac * gm.value(o) + (1 - frac) * bp.value(o) : bp.value(o); };
+
+            for(int k = 1; k < split; ++k)
+            {
+                direction o = sample();
+                if(o.length_square() == 0)
+                    continue;
+                ray scattered(rec.p, o);
+                pending[npending++] = rr_branch { scattered, beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, scattered) / value(o), i + 1 };
+            }
+
+            direction o = sample();
+            if(o.length_square() == 0)
+                break;
+            double pv = value(o);
+            ray scattered(rec.p, o);
+
+            beta = beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, scattered) / pv;
+            r = scattered;
+            specularBounce = false;
+
+            if(first && guide && guide->training() && nvert < path_guide::max_vertices)
+            {
+                guide_vertex& v = verts[nvert];
+                v.p = rec.p;
+                v.hemisphere = gmm_pdf::nearest_hemisphere(rec.normal);
+                v.dir = o.normalize();
+                v.cosine = dot(rec.normal, v.dir);
+                v.pdf = pv;
+                v.beta = beta;
+                v.L = L;
+                nvert++;
+            }
+
+            if(!adaptive && i > 3)
+            {
+                double RR = 0.05 > 1 - beta.y ? 0.05 : 1 - beta.y;
+                if(ctx.smp->get_1d() < RR)
+                    break;
+                beta = beta / (1 - RR);
+            }
+        }
+
+        // the path ended, trace the branches split off it, the latest first
+        if(first)
+            L_first = L;
+        if(npending == 0)
+            break;
+        rr_branch& b = pending[--npending];
+        r = b.r;
+        beta = b.beta;
+        i = b.depth;
+        specularBounce = false;
+        first = false;
+    }
+
+    if(nvert > 0)
+        guide->record(ctx, verts, nvert, L_first);
+    if(nrvert > 0)
+        arr->record(ctx, rverts, nrvert, L);
+
+    return L;
+}
+
+/*
+    next event estimation with multiple importance sampling
+    every diffuse vertex takes one light sample and one BRDF sample, and each of them is weighted
+    against the pdf the other strategy would have had for the same direction, so an emitter hit
+    by the BRDF sample is added instead of thrown away
+    emission seen through a specular bounce or by the camera has no competing strategy, weight 1
+*/
+inline color MIS_PT(const ray& camera_r, const BVHnode& world, const shared_ptr<geometry>& lights, int depth, thread_context& ctx, mis_heuristic h = mis_heuristic::POWER)
 {
     color L(0.0), beta(1.0);
     ray r = camera_r;
     bool specularBounce = true;
+    double brdf_pdf = 0.0;      // pdf of the BRDF sample that produced r
     
-    for(int i = 0; i < depth; ++i)
+    // one hit past depth, so the BRDF sample of the last vertex can still find its emitter
+    for(int i = 0; i <= depth; ++i)
     {
         hit_record rec;
+        ctx.rays++;
         if(!world.hit(r, rec))
+        {
+            // a light at infinity, weighted as an emitter hit
+            color Le = lights->environment(r.get_dir());
+            if(specularBounce)
+                L = L + beta * Le;
+            else if(Le.x > 0 || Le.y > 0 || Le.z > 0)
+                L = L + beta * Le * mis_weight(brdf_pdf, lights->pdf_value(r), h);
             break;
-        
-        // sampled direction from the last vertex is from a specular BRDF, add emitted term
+        }
+
+        color Le = rec.hit_mat->emitted(rec.uv);
         if(specularBounce)
-            L = L + beta * rec.hit_mat->emitted(rec.uv);
+            L = L + beta * Le;
+        else if(Le.x > 0 || Le.y > 0 || Le.z > 0)
+        {
+            double light_pdf = lights->pdf_value(r);
+            L = L + beta * Le * mis_weight(brdf_pdf, light_pdf, h);
+        }
+        if(i == depth)
+            break;
 
         scatter_record srec;
-        if(!rec.hit_mat->scatter(r, rec, srec))
+        if(!rec.hit_mat->scatter(r, rec, srec, *ctx.smp))
             break;
 
         if(srec.is_specular)
@@ -55,33 +252,44 @@ inline color MC_PT(const ray& camera_r, const BVHnode& world, const shared_ptr<g
             continue;
         }
 
+        const pdf& bp = srec.brdf_pdf;
+
         // sample light
         geometry_pdf gp(rec.p, lights);
-        direction out = gp.generate();
+        direction out = gp.generate(*ctx.smp);
         double pdf_val = gp.value(out);
         ray light_ray(rec.p, out);
 
         hit_record l_rec1, l_rec2;
-        if(world.hit(light_ray, l_rec1) && lights->hit(light_ray, l_rec2))
+        ctx.rays++;
+        if(pdf_val > 0 && world.hit(light_ray, l_rec1))
         {
-            if((l_rec1.p - l_rec2.p).length_square() < EPS)
-                L = L + beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray) * l_rec1.hit_mat->emitted(l_rec1.uv) / pdf_val;
+            if(lights->hit(light_ray, l_rec2) && (l_rec1.p - l_rec2.p).length_square() < EPS)
+            {
+                double w = mis_weight(pdf_val, bp.value(light_ray.get_dir()), h);
+                L = L + beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray) * l_rec1.hit_mat->emitted(l_rec1.uv) * w / pdf_val;
+            }
+        }
+        else if(pdf_val > 0)
+        {
+            double w = mis_weight(pdf_val, bp.value(light_ray.get_dir()), h);
+            L = L + beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray) * lights->environment(out) * w / pdf_val;
         }
 
-        // sample brdf
-        shared_ptr<pdf> bp = srec.brdf_pdf;
-        direction o = bp->generate();
-        double pv = bp->value(o);
+        // sample brdf, an emitter it hits is weighted at the next vertex
+        direction o = bp.generate(*ctx.smp);
+        double pv = bp.value(o);
         ray scattered(rec.p, o);
 
         beta = beta * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, scattered) / pv;
         r = scattered;
+        brdf_pdf = pv;
         specularBounce = false;
 
         if(i > 3)
         {
             double RR = 0.05 > 1 - beta.y ? 0.05 : 1 - beta.y;
-            if(random_double() < RR)
+            if(ctx.smp->get_1d() < RR)
                 break;
             beta = beta / (1 - RR);
         }
@@ -90,236 +298,824 @@ inline color MC_PT(const ray& camera_r, const BVHnode& world, const shared_ptr<g
     return L;
 }
 
-inline color BDPT(const ray& camera_r, const BVHnode& world, const shared_ptr<geometry>& lights, int depth)
+// light_scale resizes the ceiling light around its center, its power stays the same
+// glass_ball adds the dielectric sphere, whose caustic only light paths find easily
+// light_grid > 1 puts light_grid^2 small lights over the whole ceiling instead, 1 in 8 of them bright, in four tints
+scene cornell_scene(double aspect_ratio, double light_scale = 1.0, bool glass_ball = false, int light_grid = 1)
 {
-    vector<vertex> lightPath;
-    vector<vertex> cameraPath;
-    
-    // generate light path
-    geometry_pdf gp(point(0, 0, 0), lights);
-    direction light_dir = gp.generate();
-    double pA = 1.0 / lights->area();
+    scene sc;
+    sc.camera = Camera(point(278, 278, -800), point(278, 278, 0), direction(0, 1, 0), 40, aspect_ratio);
 
-    hit_record l_rec;
-    lights->hit(ray(point(0, 0, 0), light_dir), l_rec);
-    color beta = l_rec.hit_mat->emitted(l_rec.uv);
+    auto red   = make_shared<diffuse>(color(.65, .05, .05));
+    auto white = make_shared<diffuse>(color(.73, .73, .73));
+    auto green = make_shared<diffuse>(color(.12, .45, .15));
+    auto light_material = make_shared<diffuse_light>(color(15, 15, 15) / (light_scale * light_scale));
+    auto aluminum = make_shared<glossy>(color(0.8, 0.85, 0.88), 0.0);
+    auto glass = make_shared<dielectric>(1.5);
 
-    lightPath.push_back(vertex(l_rec.p, beta, pA, l_rec.normal));
+    sc.add(make_shared<yz_rect>(555, 0, 555, 0, 555, green));
+    sc.add(make_shared<yz_rect>(0, 0, 555, 0, 555, red));
+    sc.add(make_shared<xz_rect>(0, 0, 555, 0, 555, white));
+    sc.add(make_shared<xz_rect>(555, 0, 555, 0, 555, white));
+    sc.add(make_shared<xy_rect>(555, 0, 555, 0, 555, white));
+
+    if(glass_ball)
+        sc.add(make_shared<sphere>(point(190, 90, 190), 90, glass));
+
+    shared_ptr<geometry> box1 = make_shared<box>(point(0, 0, 0), point(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, direction(265, 0, 295));
+    sc.add(box1);
 
-    cosine_pdf cp(l_rec.normal);
-    light_dir = cp.generate();
+    if(!glass_ball)
+    {
+        shared_ptr<geometry> box2 = make_shared<box>(point(0, 0, 0), point(165, 165, 165), white);
+        box2 = make_shared<rotate_y>(box2, -18);
+        box2 = make_shared<translate>(box2, direction(130, 0, 65));
+        sc.add(box2);
+    }
 
-    ray light_ray(l_rec.p, light_dir);
-    double pw = cp.value(light_dir);
-    for(int i = 0; i < depth; ++i)
+    if(light_grid > 1)
     {
-        hit_record rec;
-        if(!world.hit(light_ray, rec))
-            break;
+        const color tints[] = { color(1.0, 0.85, 0.7), color(0.7, 0.8, 1.0), color(1.0, 0.6, 0.6), color(0.8, 1.0, 0.7) };
+        double cell = 555.0 / light_grid, half = cell / 6;
+        for(int a = 0; a < light_grid; ++a)
+            for(int b = 0; b < light_grid; ++b)
+            {
+                uint64_t h = mix_bits(a * light_grid + b);
+                color Le = tints[h % 4] * (h / 4 % 8 == 0 ? 40.0 : 2.0);
+                double x = (a + 0.5) * cell, z = (b + 0.5) * cell;
+                sc.add_light(make_shared<xz_rect>(554.9, x - half, x + half, z - half, z + half, make_shared<diffuse_light>(Le)));
+            }
+    }
+    else
+    {
+        double hx = 65 * light_scale, hz = 52.5 * light_scale;
+        sc.add_light(make_shared<xz_rect>(554.9, 278 - hx, 278 + hx, 279.5 - hz, 279.5 + hz, light_material));
+    }
 
-        scatter_record srec;
-        if(!rec.hit_mat->scatter(light_ray, rec, srec))
-            break;
+    sc.build();
+    return sc;
+}
+
+/*
+    a blue sky over a dark ground with a sun 6 degrees across, 30 degrees up, about 3/4 of the light
+    from under 1/1000 of the sphere, as width x height texels of an equirectangular map
+*/
+std::vector<color> sun_sky_texels(int width, int height)
+{
+    const direction sun = direction(std::cos(PI / 6), std::sin(PI / 6), 0.3).normalize();
+    const double sun_cos = std::cos(degree_to_radius(3.0));
+
+    std::vector<color> texels(width * height);
+    for(int v = 0; v < height; ++v)
+        for(int u = 0; u < width; ++u)
+        {
+            double theta = PI * (v + 0.5) / height, phi = 2 * PI * (u + 0.5) / width;
+            direction d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            color c = d.y > 0 ? color(0.35, 0.55, 1.0) * (0.4 + 0.6 * d.y) : color(0.08, 0.07, 0.06);
+            if(dot(d, sun) > sun_cos)
+                c = color(700, 630, 540);
+            texels[v * width + u] = c;
+        }
+    return texels;
+}
 
-        double distance_square = rec.t * rec.t;
-        double cosine = fabs(dot(light_ray.get_dir(), rec.normal));
-        pA = pw * cosine / distance_square;
+// a floor, a box and a metal ball lit only by env
+scene env_scene(double aspect_ratio, std::shared_ptr<geometry> env)
+{
+    scene sc;
+    sc.camera = Camera(point(0, 180, -700), point(0, 80, 0), direction(0, 1, 0), 40, aspect_ratio);
 
-        shared_ptr<pdf> bp = srec.brdf_pdf;
-        direction out = bp->generate();
-        pw = bp->value(out);
-        ray scattered(rec.p, out);
+    auto white = make_shared<diffuse>(color(.73, .73, .73));
+    auto red   = make_shared<diffuse>(color(.65, .05, .05));
+    auto aluminum = make_shared<glossy>(color(0.8, 0.85, 0.88), 0.0);
 
-        beta = beta * srec.attenuation * rec.hit_mat->brdf_cos(ray(), rec, ray(rec.p, -light_ray.get_dir()));
+    sc.add(make_shared<xz_rect>(0, -2000, 2000, -2000, 2000, white));
+    shared_ptr<geometry> b = make_shared<box>(point(0, 0, 0), point(120, 200, 120), red);
+    b = make_shared<rotate_y>(b, 25);
+    b = make_shared<translate>(b, direction(-200, 0, 60));
+    sc.add(b);
+    sc.add(make_shared<sphere>(point(10, 70, 0), 70, aluminum));
+    sc.add_environment(env);
 
-        lightPath.push_back(vertex(rec.p, beta, pA, rec.normal));
-        
-        light_ray = scattered;
+    sc.build();
+    return sc;
+}
 
-        if(i > 3)
+// integrator(camera ray, thread_context&) returns the radiance of one sample
+template <class F>
+render_stats render(const scene& sc, FrameBuffer& fb, thread_pool& pool, int sample_per_pixel, F&& integrator,
+                    const sampler& proto = independent_sampler(), int tile_size = 16)
+{
+    const int width = fb.get_width(), height = fb.get_height();
+
+    return render_tiles(fb, pool, tile_size, [&](int i, int j, thread_context& ctx) {
+        // samples are summed in index order, whichever thread owns the pixel
+        color result(0, 0, 0);
+        for(int k = 0; k < sample_per_pixel; ++k)
         {
-            double RR = 0.05 > 1 - beta.y ? 0.05 : 1 - beta.y;
-            if(random_double() < RR)
-                break;
-            beta = beta / (1 - RR);
+            ctx.smp->start_pixel_sample(i, j, k);
+            ctx.pixel = i * width + j;
+
+            coord jitter = ctx.smp->get_2d();
+            double u = (i + jitter.x) / height;
+            double v = (j + jitter.y) / width;
+
+            ray r = sc.camera.get_ray(v, u);
+            result = result + integrator(r, ctx);
         }
-    }
+        ctx.samples += sample_per_pixel;
 
-    double mul_pw = 1.0;
-    for(int i = 0; i < (int)lightPath.size() - 1; ++i)
-    {
-        vertex current = lightPath[i];
-        vertex next = lightPath[i + 1];
+        return result / sample_per_pixel;
+    }, proto);
+}
 
-        double distance_square = (current.p - next.p).length_square();
-        double cosine = fabs(dot((current.p - next.p).normalize(), current.norm));
+void cornell_box()
+{
+    const double aspect_ratio = 1.0;
+    const int height = 600, width = height * aspect_ratio;
+    const int max_depth = 5;
+    const int sample_per_pixel = 10;
 
-        mul_pw *= current.pA * distance_square / cosine;
+    FrameBuffer fb(width, height);
+    scene sc = cornell_scene(aspect_ratio);
 
-        lightPath[i + 1].beta = lightPath[i + 1].beta / mul_pw;
-    }
+    thread_pool pool;
 
-    // generate camera path
-    ray r = camera_r;
-    beta = color(1.0);
-    for(int i = 0; i < depth; ++i)
-    {
-        hit_record rec;
-        if(!world.hit(r, rec))
-            break;
-        
-        scatter_record srec;
-        if(!rec.hit_mat->scatter(r, rec, srec))
-            break;
+    // render_stats stats = render(sc, fb, pool, sample_per_pixel, [&](const ray& r, thread_context& ctx) {
+    //     return MC_PT(r, sc.world, sc.lights, max_depth, ctx);
+    // });
+    bdpt_integrator bdpt(sc, max_depth);
+    render_stats stats = bdpt.render(fb, pool, sample_per_pixel);
 
-        shared_ptr<pdf> bp = srec.brdf_pdf;
-        direction o = bp->generate();
-        double pv = bp->value(o);
-        ray scattered(rec.p, o);
+    std::cout << pool.size() << " threads. ";
+    stats.show();
 
-        beta = beta * srec.attenuation;
-        r = scattered;
+    fb.output("./images/test.ppm");
+}
 
-        cameraPath.push_back(vertex(rec.p, beta, pv / rec.hit_mat->brdf_cos(r, rec, scattered), rec.normal));
+// the same image, bit for bit, for any thread count and tile size
+void determinism_test()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int sample_per_pixel = 4;
 
-        if(i > 3)
+    scene sc = cornell_scene(1.0);
+
+    int nthread = std::thread::hardware_concurrency();
+    std::vector<std::pair<int, int> > configs { {1, 16}, {4, 16}, {4, 8}, {nthread, 16}, {nthread, 4} };
+
+    bool ok = true;
+    const char* names[] = { "MC_PT", "BDPT", "BDPT pool", "SPPM", "MC_PT guided", "MC_PT vMF guided", "MC_PT ADRRS", "ReSTIR", "PSSMLT", "wavefront" };
+    for(int m = 0; m < 10; ++m)
+    {
+        uint64_t reference = 0;
+        for(int c = 0; c < (int)configs.size(); ++c)
         {
-            double RR = 0.05 > 1 - beta.y ? 0.05 : 1 - beta.y;
-            if(random_double() < RR)
-                break;
-            beta = beta / (1 - RR);
+            FrameBuffer fb(width, height);
+            thread_pool pool(configs[c].first);
+
+            if(m == 0)
+                render(sc, fb, pool, sample_per_pixel, [&](const ray& r, thread_context& ctx) {
+                    return MC_PT(r, sc.world, sc.lights, max_depth, ctx);
+                }, independent_sampler(), configs[c].second);
+            else if(m == 3)
+                sppm_integrator(sc, max_depth).render(fb, pool, sample_per_pixel);
+            else if(m == 4 || m == 5)
+            {
+                path_guide guide(pool.size(), m == 4 ? GUIDE_DIST::GUIDE_GMM : GUIDE_DIST::GUIDE_VMM);
+                auto guided = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, &guide); };
+                for(int pass = 0; pass < 3; ++pass)
+                {
+                    guide.begin_training();
+                    render(sc, fb, pool, 1 << pass, guided, independent_sampler(1000 + pass), configs[c].second);
+                    guide.end_training();
+                }
+                guide.finish_training();
+                render(sc, fb, pool, sample_per_pixel, guided, independent_sampler(), configs[c].second);
+            }
+            else if(m == 7)
+                restir_integrator(sc, max_depth).render(fb, pool, sample_per_pixel);
+            else if(m == 9)
+                wavefront_integrator(sc, max_depth).render(fb, pool, sample_per_pixel);
+            else if(m == 8)
+                pssmlt_integrator(sc, 16, 4096).render(fb, pool, sample_per_pixel, [&](const ray& r, thread_context& ctx) {
+                    return MC_PT(r, sc.world, sc.lights, max_depth, ctx);
+                });
+            else if(m == 6)
+            {
+                adaptive_rr arr(width, height, pool.size());
+                auto adaptive = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, nullptr, &arr); };
+                arr.begin_prepass();
+                render(sc, fb, pool, 2, adaptive, independent_sampler(1000), configs[c].second);
+                arr.end_prepass(fb);
+                render(sc, fb, pool, sample_per_pixel, adaptive, independent_sampler(), configs[c].second);
+            }
+            else
+            {
+                bdpt_integrator bdpt(sc, max_depth);
+                bdpt.set_light_reuse(m == 2 ? 4 : 0);
+                bdpt.render(fb, pool, sample_per_pixel, independent_sampler(), configs[c].second);
+            }
+
+            uint64_t h = fb.checksum();
+            if(c == 0) reference = h;
+            ok &= (h == reference);
+
+            std::cout << names[m] << " threads " << configs[c].first << " tile " << configs[c].second
+                      << ": " << std::hex << h << std::dec << (h == reference ? "" : "  MISMATCH") << std::endl;
         }
     }
 
-    double mul_pv = 1.0;
-    for(int i = 0; i < (int)cameraPath.size() - 1; ++i)
+    std::cout << (ok ? "deterministic" : "NOT deterministic") << std::endl;
+}
+
+// RMSE against a high sample count reference, for every sampler and sample count
+void sampler_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 4096;
+
+    scene sc = cornell_scene(1.0);
+    thread_pool pool;
+
+    auto integrator = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); };
+
+    FrameBuffer ref(width, height);
+    render(sc, ref, pool, reference_spp, integrator, independent_sampler(0xdeadbeef));
+
+    std::vector<std::pair<std::string, std::shared_ptr<sampler> > > samplers {
+        {"independent", make_shared<independent_sampler>()},
+        {"stratified", nullptr},
+        {"sobol", make_shared<sobol_sampler>()},
+        {"halton", make_shared<halton_sampler>()},
+        {"blue noise", make_shared<blue_noise_sampler>()}
+    };
+
+    std::cout << "sampler        spp     time(s)   RMSE" << std::endl;
+    for(auto& s : samplers)
+        for(int spp = 1; spp <= 256; spp *= 4)
+        {
+            // strata have to match the sample count
+            std::shared_ptr<sampler> smp = s.second;
+            if(!smp)
+            {
+                int xs = 1;
+                while(xs * xs < spp) xs++;
+                smp = make_shared<stratified_sampler>(xs, spp / xs);
+            }
+
+            FrameBuffer fb(width, height);
+            render_stats stats = render(sc, fb, pool, spp, integrator, *smp);
+
+            printf("%-12s %5d %11.4f   %.6f\n", s.first.c_str(), spp, stats.seconds, sqrt(fb.mse(ref)));
+        }
+}
+
+// throughput of the wavefront integrator against MC_PT, and how far apart their images are
+// then the same wavefront render without reordering, with ray sorting, and with ray and material sorting
+void wavefront_benchmark()
+{
+    const int height = 256, width = 256;
+    const int max_depth = 5;
+    const int sample_per_pixel = 64;
+
+    scene sc = cornell_scene(1.0);
+    scene sky = env_scene(1.0, make_shared<environment_light>(512, 256, sun_sky_texels(512, 256)));
+    perf_counter counter;       // before the pool, so the workers inherit it
+    thread_pool pool;
+
+    // the same estimator, so the images differ only by the order of the adds
+    FrameBuffer fb_wf(width, height);
+    for(const scene* s : {&sc, &sky})
     {
-        mul_pv *= cameraPath[i].pA;
-        cameraPath[i + 1].beta = cameraPath[i + 1].beta / mul_pv;
+        FrameBuffer fb_pt(width, height);
+        render_stats pt = render(*s, fb_pt, pool, sample_per_pixel, [&](const ray& r, thread_context& ctx) {
+            return MC_PT(r, s->world, s->lights, max_depth, ctx);
+        });
+        std::cout << (s == &sc ? "cornell box" : "environment") << std::endl;
+        std::cout << "MC_PT     "; pt.show();
+
+        wavefront_integrator wf(*s, max_depth);
+        render_stats st = wf.render(fb_wf, pool, sample_per_pixel);
+        std::cout << "wavefront "; st.show();
+
+        double max_diff = 0.0;
+        for(int i = 0; i < height; ++i)
+            for(int j = 0; j < width; ++j)
+            {
+                color d = fb_pt.get_pixel(i, j) - fb_wf.get_pixel(i, j);
+                max_diff = std::max(max_diff, std::max(fabs(d.x), std::max(fabs(d.y), fabs(d.z))));
+            }
+        std::cout << "RMSE between the images " << sqrt(fb_wf.mse(fb_pt)) << ", max difference " << max_diff << std::endl;
+        std::cout << "speedup " << pt.seconds / st.seconds << std::endl;
     }
 
-    // connect path
-    color L(0.0);
-    double weight = 0.0;
+    // reordering on the box, fb_wf is rendered again to compare with
+    wavefront_integrator wf(sc, max_depth);
+    wf.render(fb_wf, pool, sample_per_pixel);
 
-    int s = lightPath.size(), t = cameraPath.size();
+    if(!counter.valid())
+        std::cout << "perf events unavailable, cache misses are not counted" << std::endl;
+    wf.set_counter(&counter);
 
-    double w = 1.0;
-    for(int j = 0; j < s; ++j)
+    const char* names[3] = { "unsorted", "rays sorted", "rays + materials sorted" };
+    for(int c = 0; c < 3; ++c)
     {
-        vertex li = lightPath[j];
-        for(int i = 0; i < t; ++i)
+        wf.set_reorder(c >= 1, c >= 2);
+        FrameBuffer fb(width, height);
+        render_stats s = wf.render(fb, pool, sample_per_pixel);
+        std::cout << names[c] << (fb.checksum() == fb_wf.checksum() ? "" : " (image differs)") << std::endl;
+        std::cout << "  "; s.show();
+        std::cout << "  "; wf.get_coherence().show();
+    }
+}
+
+// mean squared error of the displayed image, channels clamped to 1, so the directly seen light does not dominate
+double display_mse(const FrameBuffer& fb, const FrameBuffer& ref)
+{
+    double s = 0.0;
+    for(int i = 0; i < fb.get_height(); ++i)
+        for(int j = 0; j < fb.get_width(); ++j)
         {
-            vertex ca = cameraPath[i];
+            color a = fb.get_pixel(i, j), b = ref.get_pixel(i, j);
+            color d(fmin(a.x, 1.0) - fmin(b.x, 1.0), fmin(a.y, 1.0) - fmin(b.y, 1.0), fmin(a.z, 1.0) - fmin(b.z, 1.0));
+            s += dot(d, d);
+        }
+    return s / (3.0 * fb.get_width() * fb.get_height());
+}
 
-            ray connect(ca.p, li.p - ca.p);
-            hit_record rec;
-            if(!world.hit(connect, rec))
-                continue;
+// error against time of MC_PT and MIS_PT, for a small, the default and a large light
+void mis_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 4096;
 
-            if((rec.p - li.p).length_square() > EPS)
-                continue;
+    thread_pool pool;
 
-            double distance_square = rec.t * rec.t;
-            double cosine = fabs(dot(connect.get_dir(), li.norm));
-            pw = li.pA * distance_square / cosine;
+    for(double light_scale : {0.25, 1.0, 3.0})
+    {
+        scene sc = cornell_scene(1.0, light_scale);
 
-            // std::cout << distance_square << " " << cosine << " " << li.pA << std::endl;
-            // std::cout << ca.beta << " " << li.beta << " " << pw << std::endl;
+        std::vector<std::pair<std::string, std::function<color(const ray&, thread_context&)> > > integrators {
+            {"MC_PT", [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); }},
+            {"MIS balance", [&](const ray& r, thread_context& ctx) { return MIS_PT(r, sc.world, sc.lights, max_depth, ctx, mis_heuristic::BALANCE); }},
+            {"MIS power", [&](const ray& r, thread_context& ctx) { return MIS_PT(r, sc.world, sc.lights, max_depth, ctx, mis_heuristic::POWER); }}
+        };
 
-            ray _c(li.p, ca.p - li.p);
-            world.hit(_c, rec);
+        FrameBuffer ref(width, height);
+        render(sc, ref, pool, reference_spp, integrators[2].second, independent_sampler(0xdeadbeef));
 
-            L = L + ca.beta * li.beta * rec.hit_mat->brdf_cos(ray(), rec, connect) / pw * w;
-        }
+        printf("light scale %.2f\n", light_scale);
+        printf("integrator     spp     time(s)   RMSE       1/(MSE*time)\n");
+        for(auto& it : integrators)
+            for(int spp = 4; spp <= 256; spp *= 4)
+            {
+                // a fresh seed per row, so a rare bright path does not repeat in every larger count
+                FrameBuffer fb(width, height);
+                render_stats stats = render(sc, fb, pool, spp, it.second, independent_sampler(spp));
+                double mse = display_mse(fb, ref);
+                printf("%-12s %5d %11.4f   %.6f   %.1f\n", it.first.c_str(), spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+            }
+    }
+}
+
+// error against time of MIS_PT and BDPT, on the box scene and on the glass ball with its caustic
+void bdpt_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 2048;
+
+    thread_pool pool;
+
+    for(bool glass_ball : {false, true})
+    {
+        scene sc = cornell_scene(1.0, 1.0, glass_ball);
+        bdpt_integrator bdpt(sc, max_depth);
+        auto pt = [&](const ray& r, thread_context& ctx) { return MIS_PT(r, sc.world, sc.lights, max_depth, ctx); };
+
+        FrameBuffer ref(width, height);
+        bdpt.render(ref, pool, reference_spp, independent_sampler(0xdeadbeef));
+
+        printf("%s\n", glass_ball ? "glass ball" : "two boxes");
+        printf("integrator     spp     time(s)   RMSE       1/(MSE*time)\n");
 
-        weight += w;
-        w *= 0.1;
+        // light reuse with k connections per camera vertex, 0 is plain BDPT
+        const char* names[] = { "MIS_PT", "BDPT", "BDPT pool 1", "BDPT pool 4" };
+        const int reuse[] = { 0, 0, 1, 4 };
+        for(int m = 0; m < 4; ++m)
+            for(int spp = 4; spp <= 256; spp *= 4)
+            {
+                FrameBuffer fb(width, height);
+                bdpt.set_light_reuse(reuse[m]);
+                render_stats stats = m == 0 ? render(sc, fb, pool, spp, pt, independent_sampler(spp))
+                                            : bdpt.render(fb, pool, spp, independent_sampler(spp));
+                double mse = display_mse(fb, ref);
+                printf("%-12s %5d %11.4f   %.6f   %.1f\n", names[m], spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+            }
     }
+}
 
-    
-    if(weight > 0) 
-        return L / weight;
-    return L;
+// caustics of the glass ball, progressive SPPM read out along the way against BDPT
+void sppm_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 2048;
+
+    thread_pool pool;
+    scene sc = cornell_scene(1.0, 1.0, true);
+
+    FrameBuffer ref(width, height);
+    bdpt_integrator(sc, max_depth).render(ref, pool, reference_spp, independent_sampler(0xdeadbeef));
+
+    printf("integrator     spp     time(s)   RMSE       1/(MSE*time)\n");
+    for(int spp = 4; spp <= 256; spp *= 4)
+    {
+        FrameBuffer fb(width, height);
+        render_stats stats = bdpt_integrator(sc, max_depth).render(fb, pool, spp, independent_sampler(spp));
+        double mse = display_mse(fb, ref);
+        printf("%-12s %5d %11.4f   %.6f   %.1f\n", "BDPT", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+    }
+
+    sppm_integrator sppm(sc, max_depth);
+    sppm.begin(width, height);
+    double seconds = 0.0;
+    for(int pass = 1; pass <= 256; ++pass)
+    {
+        seconds += sppm.pass(pool).seconds;
+        if(pass == 4 || pass == 16 || pass == 64 || pass == 256)
+        {
+            FrameBuffer fb(width, height);
+            sppm.output(fb);
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %.1f\n", "SPPM", pass, seconds, sqrt(mse), 1.0 / (mse * seconds));
+        }
+    }
 }
 
-void cornell_box()
+// MC_PT against MC_PT with an irradiance cache at the first diffuse vertex
+void irradiance_benchmark()
 {
-    const double aspect_ratio = 1.0;
-    const int height = 600, width = height * aspect_ratio;
+    const int height = 128, width = 128;
     const int max_depth = 5;
-    const int sample_per_pixel = 10;
+    const int reference_spp = 1024;
 
-    FrameBuffer fb(width, height);
-    
-    Camera mycamera(point(278, 278, -800), point(278, 278, 0), direction(0, 1, 0), 40, aspect_ratio);
+    thread_pool pool;
+    scene sc = cornell_scene(1.0);
+    auto pt = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); };
 
-    geometry_list world;
+    FrameBuffer ref(width, height);
+    render(sc, ref, pool, reference_spp, pt, independent_sampler(0xdeadbeef));
 
-    auto red   = make_shared<diffuse>(color(.65, .05, .05));
-    auto white = make_shared<diffuse>(color(.73, .73, .73));
-    auto green = make_shared<diffuse>(color(.12, .45, .15));
-    auto light_material = make_shared<diffuse_light>(color(15, 15, 15));
-    auto aluminum = make_shared<glossy>(color(0.8, 0.85, 0.88), 0.0);
-    auto glass = make_shared<dielectric>(1.5);
+    // radii in pixels at the back wall
+    const double pixel = 555.0 / height;
 
-    world.add(make_shared<yz_rect>(555, 0, 555, 0, 555, green));
-    world.add(make_shared<yz_rect>(0, 0, 555, 0, 555, red));
-    world.add(make_shared<xz_rect>(0, 0, 555, 0, 555, white));
-    world.add(make_shared<xz_rect>(555, 0, 555, 0, 555, white));
-    world.add(make_shared<xy_rect>(555, 0, 555, 0, 555, white));
+    printf("integrator     spp     time(s)   RMSE       1/(MSE*time)   rays/spp   records\n");
+    for(int spp = 16; spp <= 256; spp *= 4)
+    {
+        FrameBuffer fb(width, height);
+        render_stats stats = render(sc, fb, pool, spp, pt, independent_sampler(spp));
+        double mse = display_mse(fb, ref);
+        printf("%-12s %5d %11.4f   %.6f   %8.1f       %6.2f\n", "MC_PT", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds),
+               (double)stats.rays / stats.samples);
+    }
+    for(int spp = 1; spp <= 16; spp *= 4)
+    {
+        irradiance_cache cache(sc, pool.size(), 1.5 * pixel, 20 * pixel);
+        FrameBuffer fb(width, height);
+        render_stats stats = render(sc, fb, pool, spp, [&](const ray& r, thread_context& ctx) {
+            return MC_PT(r, sc.world, sc.lights, max_depth, ctx, &cache);
+        }, independent_sampler(spp));
+        double mse = display_mse(fb, ref);
+        printf("%-12s %5d %11.4f   %.6f   %8.1f       %6.2f     %d\n", "MC_PT cache", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds),
+               (double)stats.rays / stats.samples, cache.size());
+    }
+}
 
-    // shared_ptr<geometry> ball = make_shared<sphere>(point(190, 90, 190), 90, glass);
-    // world.add(ball);
+// MC_PT against MC_PT guided by WGMMs and by VMMs, with a panel under the ceiling light so the room only sees light the ceiling bounces
+void guide_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 8;
+    const int reference_spp = 8192;
 
-    shared_ptr<geometry> box1 = make_shared<box>(point(0, 0, 0), point(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, direction(265, 0, 295));
-    world.add(box1);
+    thread_pool pool;
+    scene sc = cornell_scene(1.0);
+    sc.add(make_shared<xz_rect>(500, 178, 378, 179.5, 379.5, make_shared<diffuse>(color(.73, .73, .73))));
+    sc.build();
+    auto pt = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); };
 
-    shared_ptr<geometry> box2 = make_shared<box>(point(0, 0, 0), point(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, direction(130, 0, 65));
-    world.add(box2);
+    FrameBuffer ref(width, height);
+    render(sc, ref, pool, reference_spp, pt, independent_sampler(0xdeadbeef));
 
-    shared_ptr<geometry> light = make_shared<xz_rect>(554.9, 213, 343, 227, 332, light_material);
-    world.add(light);
+    printf("integrator     spp     time(s)   RMSE       1/(MSE*time)   regions   queue peak   dropped\n");
+    for(int spp = 16; spp <= 256; spp *= 4)
+    {
+        FrameBuffer fb(width, height);
+        render_stats stats = render(sc, fb, pool, spp, pt, independent_sampler(spp));
+        double mse = display_mse(fb, ref);
+        printf("%-12s %5d %11.4f   %.6f   %8.1f\n", "MC_PT", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+    }
 
-    shared_ptr<geometry_list> lights = make_shared<geometry_list>();
-    lights->add(light);
+    // training passes of 1, 2, 4 and 8 spp are thrown away, their time is counted
+    for(int d = 0; d < 2; ++d)
+    for(int spp = 16; spp <= 256; spp *= 4)
+    {
+        path_guide guide(pool.size(), d == 0 ? GUIDE_DIST::GUIDE_GMM : GUIDE_DIST::GUIDE_VMM);
+        auto guided = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, &guide); };
 
-    BVHnode bvh(world);
+        auto start = std::chrono::steady_clock::now();
+        for(int pass = 0; pass < 4; ++pass)
+        {
+            FrameBuffer fb(width, height);
+            guide.begin_training();
+            render(sc, fb, pool, 1 << pass, guided, independent_sampler(1000 + pass));
+            guide.end_training();
+        }
+        guide.finish_training();
+        FrameBuffer fb(width, height);
+        render(sc, fb, pool, spp, guided, independent_sampler(spp));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double mse = display_mse(fb, ref);
+        printf("%-12s %5d %11.4f   %.6f   %8.1f      %4d      %7zu   %7lld\n", d == 0 ? "MC_PT GMM" : "MC_PT vMF", spp, seconds, sqrt(mse),
+               1.0 / (mse * seconds), guide.size(), guide.max_queue_depth(), guide.dropped());
+    }
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j)
+    // the same training passes once, saved, then every render loads the file and guides from its first sample
+    const std::string file = "guide_benchmark.bin";
+    for(int d = 0; d < 2; ++d)
+    {
+        GUIDE_DIST dist = d == 0 ? GUIDE_DIST::GUIDE_GMM : GUIDE_DIST::GUIDE_VMM;
         {
-            color result(0, 0, 0);
-            for(int k = 0; k < sample_per_pixel; ++k)
+            path_guide guide(pool.size(), dist);
+            auto guided = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, &guide); };
+            for(int pass = 0; pass < 4; ++pass)
+            {
+                FrameBuffer fb(width, height);
+                guide.begin_training();
+                render(sc, fb, pool, 1 << pass, guided, independent_sampler(1000 + pass));
+                guide.end_training();
+            }
+            guide.finish_training();
+            if(!guide.save(file, sc.hash()))
             {
-                double u = (i + random_double()) / height;
-                double v = (j + random_double()) / width;
+                printf("cannot write %s\n", file.c_str());
+                return;
+            }
+        }
 
-                ray r = mycamera.get_ray(v, u);
-                // color rc = MC_PT(r, bvh, lights, max_depth);
-                color rc = BDPT(r, bvh, lights, max_depth);
+        path_guide other(pool.size(), dist);
+        if(other.load(file, sc.hash(1)))
+            printf("loaded a model of another scene\n");
 
-                result = result + rc;
-            }
+        for(int spp = 16; spp <= 256; spp *= 4)
+        {
+            path_guide guide(pool.size(), dist);
+            auto guided = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, &guide); };
+
+            auto start = std::chrono::steady_clock::now();
+            bool loaded = guide.load(file, sc.hash());
+            FrameBuffer fb(width, height);
+            render(sc, fb, pool, spp, guided, independent_sampler(spp));
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %8.1f      %4d%s\n", d == 0 ? "GMM loaded" : "vMF loaded", spp, seconds, sqrt(mse),
+                   1.0 / (mse * seconds), guide.size(), loaded ? "" : "   (load failed)");
+        }
+    }
+    std::remove(file.c_str());
+}
 
-            fb.set_pixel(i, j, result / sample_per_pixel);
+/*
+    error against time of MC_PT with the fixed roulette and with adaptive roulette and splitting,
+    whose pre-pass of 4 spp is counted in its time, on the Cornell box, with a small light and with
+    the glass ball
+*/
+void rr_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 12;
+    const int reference_spp = 8192;
+    const int prepass_spp = 4;
+
+    thread_pool pool;
+    std::vector<std::pair<std::string, scene> > scenes;
+    scenes.emplace_back("cornell", cornell_scene(1.0));
+    scenes.emplace_back("small light", cornell_scene(1.0, 0.25));
+    scenes.emplace_back("glass ball", cornell_scene(1.0, 1.0, true));
+
+    for(auto& named : scenes)
+    {
+        const scene& sc = named.second;
+        auto pt = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); };
+
+        FrameBuffer ref(width, height);
+        render(sc, ref, pool, reference_spp, pt, independent_sampler(0xdeadbeef));
+
+        printf("%s\n", named.first.c_str());
+        printf("integrator     spp     time(s)   RMSE       1/(MSE*time)   rays/spp   regions\n");
+        for(int spp = 16; spp <= 256; spp *= 4)
+        {
+            FrameBuffer fb(width, height);
+            render_stats stats = render(sc, fb, pool, spp, pt, independent_sampler(spp));
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %8.1f       %6.2f\n", "fixed RR", spp, stats.seconds, sqrt(mse),
+                   1.0 / (mse * stats.seconds), (double)stats.rays / stats.samples);
         }
 
-    fb.output("./images/test.ppm");
+        for(int spp = 16; spp <= 256; spp *= 4)
+        {
+            adaptive_rr arr(width, height, pool.size());
+            auto adaptive = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx, nullptr, nullptr, &arr); };
+
+            auto start = std::chrono::steady_clock::now();
+            FrameBuffer pre(width, height);
+            arr.begin_prepass();
+            render(sc, pre, pool, prepass_spp, adaptive, independent_sampler(1000));
+            arr.end_prepass(pre);
+
+            FrameBuffer fb(width, height);
+            render_stats stats = render(sc, fb, pool, spp, adaptive, independent_sampler(spp));
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %8.1f       %6.2f     %5d\n", "ADRRS", spp, seconds, sqrt(mse),
+                   1.0 / (mse * seconds), (double)stats.rays / stats.samples, arr.size());
+        }
+    }
+}
+
+/*
+    error against time of MC_PT and MIS_PT under an environment light, its directions sampled by the
+    luminance of the map or uniformly over the sphere; the map is the sun and sky of sun_sky_texels,
+    or the image at path
+*/
+void env_benchmark(const std::string& path)
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 16384;
+    const int map_width = 512, map_height = 256;
+
+    auto make_env = [&](bool importance) -> shared_ptr<environment_light> {
+        if(path.empty())
+            return make_shared<environment_light>(map_width, map_height, sun_sky_texels(map_width, map_height), importance);
+        return make_shared<environment_light>(path, 1.0, importance);
+    };
+
+    thread_pool pool;
+    scene sc = env_scene(1.0, make_env(true));
+    scene uniform = env_scene(1.0, make_env(false));
+
+    FrameBuffer ref(width, height);
+    render(sc, ref, pool, reference_spp, [&](const ray& r, thread_context& ctx) {
+        return MIS_PT(r, sc.world, sc.lights, max_depth, ctx);
+    }, independent_sampler(0xdeadbeef));
+
+    printf("integrator     env          spp     time(s)   RMSE       1/(MSE*time)\n");
+    for(int m = 0; m < 4; ++m)
+    {
+        const scene& s = m % 2 == 0 ? sc : uniform;
+        for(int spp = 4; spp <= 256; spp *= 4)
+        {
+            FrameBuffer fb(width, height);
+            render_stats stats = render(s, fb, pool, spp, [&](const ray& r, thread_context& ctx) {
+                return m < 2 ? MC_PT(r, s.world, s.lights, max_depth, ctx) : MIS_PT(r, s.world, s.lights, max_depth, ctx);
+            }, independent_sampler(spp));
+            double mse = display_mse(fb, ref);
+            printf("%-12s %-10s %5d %11.4f   %.6f   %8.1f\n", m < 2 ? "MC_PT" : "MIS_PT", m % 2 == 0 ? "luminance" : "uniform",
+                   spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+        }
+    }
+
+    FrameBuffer fb(4 * width, 4 * height);
+    render(sc, fb, pool, 64, [&](const ray& r, thread_context& ctx) { return MIS_PT(r, sc.world, sc.lights, max_depth, ctx); });
+    fb.output("./images/env.ppm");
 }
 
-int main()
+/*
+    error against time of direct light under 64 lights: MC_PT's one light sample per vertex (a path
+    of depth 1), and resampled direct light with no reuse, temporal, spatial and both, a pass each spp
+*/
+void restir_benchmark()
 {
-    clock_t start = clock();
+    const int height = 64, width = 64;
+    const int reference_spp = 4096;
 
-    cornell_box();
+    thread_pool pool;
+    scene sc = cornell_scene(1.0, 1.0, false, 8);
+    auto direct = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, 1, ctx); };
 
-    clock_t end = clock();
-    std::cout << (double)(end - start) / CLOCKS_PER_SEC << std::endl;
+    FrameBuffer ref(width, height);
+    render(sc, ref, pool, reference_spp, direct, independent_sampler(0xdeadbeef));
+
+    printf("integrator           spp     time(s)   RMSE       1/(MSE*time)   rays/spp\n");
+    for(int spp = 1; spp <= 64; spp *= 4)
+    {
+        FrameBuffer fb(width, height);
+        render_stats stats = render(sc, fb, pool, spp, direct, independent_sampler(spp));
+        double mse = display_mse(fb, ref);
+        printf("%-18s %5d %11.4f   %.6f   %8.1f       %6.2f\n", "MC_PT direct", spp, stats.seconds, sqrt(mse),
+               1.0 / (mse * stats.seconds), (double)stats.rays / stats.samples);
+    }
+
+    const char* names[] = { "RIS", "RIS temporal", "RIS spatial", "ReSTIR" };
+    for(int m = 0; m < 4; ++m)
+        for(int spp = 1; spp <= 64; spp *= 4)
+        {
+            FrameBuffer fb(width, height);
+            restir_integrator restir(sc, 5, 32, m == 1 || m == 3, m >= 2 ? 4 : 0);
+            render_stats stats = restir.render(fb, pool, spp, independent_sampler(spp));
+            double mse = display_mse(fb, ref);
+            printf("%-18s %5d %11.4f   %.6f   %8.1f       %6.2f\n", names[m], spp, stats.seconds, sqrt(mse),
+                   1.0 / (mse * stats.seconds), (double)stats.rays / stats.samples);
+        }
+}
+
+/*
+    error against time of MC_PT and of PSSMLT over the same MC_PT, spp is mutations per pixel for
+    PSSMLT, its bootstrap included in the time; the small light and the glass ball's caustic are
+    where a chain that found a bright path can stay near it
+*/
+void mlt_benchmark()
+{
+    const int height = 64, width = 64;
+    const int max_depth = 5;
+    const int reference_spp = 2048;
+
+    thread_pool pool;
+
+    for(bool glass_ball : {false, true})
+    {
+        scene sc = cornell_scene(1.0, glass_ball ? 1.0 : 0.25, glass_ball);
+        auto pt = [&](const ray& r, thread_context& ctx) { return MC_PT(r, sc.world, sc.lights, max_depth, ctx); };
+
+        FrameBuffer ref(width, height);
+        bdpt_integrator(sc, max_depth).render(ref, pool, reference_spp, independent_sampler(0xdeadbeef));
+
+        printf("%s\n", glass_ball ? "glass ball" : "small light");
+        printf("integrator     spp     time(s)   RMSE       1/(MSE*time)   acceptance\n");
+        for(int spp = 4; spp <= 256; spp *= 4)
+        {
+            FrameBuffer fb(width, height);
+            render_stats stats = render(sc, fb, pool, spp, pt, independent_sampler(spp));
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %8.1f\n", "MC_PT", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds));
+        }
+        for(int spp = 4; spp <= 256; spp *= 4)
+        {
+            FrameBuffer fb(width, height);
+            pssmlt_integrator mlt(sc, 64, 100000, 0.01, 0.3, spp);
+            render_stats stats = mlt.render(fb, pool, spp, pt);
+            double mse = display_mse(fb, ref);
+            printf("%-12s %5d %11.4f   %.6f   %8.1f       %.3f\n", "PSSMLT", spp, stats.seconds, sqrt(mse), 1.0 / (mse * stats.seconds),
+                   mlt.acceptance());
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::string mode = argc > 1 ? argv[1] : "";
+    if(mode == "determinism")
+        determinism_test();
+    else if(mode == "sampler")
+        sampler_benchmark();
+    else if(mode == "wavefront")
+        wavefront_benchmark();
+    else if(mode == "mis")
+        mis_benchmark();
+    else if(mode == "bdpt")
+        bdpt_benchmark();
+    else if(mode == "sppm")
+        sppm_benchmark();
+    else if(mode == "irradiance")
+        irradiance_benchmark();
+    else if(mode == "guide")
+        guide_benchmark();
+    else if(mode == "rr")
+        rr_benchmark();
+    else if(mode == "restir")
+        restir_benchmark();
+    else if(mode == "mlt")
+        mlt_benchmark();
+    else if(mode == "env")
+        env_benchmark(argc > 2 ? argv[2] : "");
+    else
+        cornell_box();
+
+    auto end = std::chrono::steady_clock::now();
+    std::cout << std::chrono::duration<double>(end - start).count() << std::endl;
 
     return 0;
 }
\ No newline at end of file
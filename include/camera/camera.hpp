@@ -11,6 +11,7 @@ private:
     direction low_left;
     direction horizontal;
     direction vertical;
+    direction forward;      // |forward| = 1, the image plane is at distance 1
 
 public:
     Camera(point lookfrom = point(0, 0, 1), 
@@ -23,7 +24,7 @@ public:
         double height = 2 * tan(degree_to_radius(vfov) / 2) * focal_length;
         double width = height * aspect_ratio;
 
-        direction forward = lookat - lookfrom;
+        forward = (lookat - lookfrom).normalize();
 
         origin = lookfrom;
         horizontal = cross(forward, up).normalize() * width;
@@ -31,8 +32,25 @@ public:
         low_left = forward.normalize() * focal_length - horizontal * 0.5 - vertical * 0.5;
     }
 
-    inline ray get_ray(double w, double h)
+    inline ray get_ray(double w, double h) const
     {
         return ray(origin, low_left + horizontal * w + vertical * h);
     }
+
+    inline point get_origin() const { return origin; }
+    inline direction get_forward() const { return forward; }
+    inline double plane_area() const { return horizontal.length() * vertical.length(); }
+
+    // inverse of get_ray, (w, h) of the image point that sees p, false if p is behind or outside the image
+    inline bool project(const point& p, double& w, double& h) const
+    {
+        direction d = p - origin;
+        double z = dot(d, forward);
+        if(z <= 0) return false;
+
+        direction q = d / z - low_left;
+        w = dot(q, horizontal) / horizontal.length_square();
+        h = dot(q, vertical) / vertical.length_square();
+        return w >= 0 && w < 1 && h >= 0 && h < 1;
+    }
 };
\ No newline at end of file
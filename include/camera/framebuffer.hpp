@@ -5,6 +5,7 @@
 #include <memory>
 #include <string>
 #include <cmath>
+#include <cstdint>
 #include "math/vector.hpp"
 
 /*
@@ -31,9 +32,37 @@ public:
     }
     ~FrameBuffer() { delete[] data; }
 
+    inline int get_width() const { return width; }
+    inline int get_height() const { return height; }
     inline color get_pixel(int row, int col) const { return data[row * width + col]; }
     inline void set_pixel(int row, int col, color c) { data[row * width + col] = c; }
 
+    // mean squared error against a reference of the same size
+    double mse(const FrameBuffer& ref) const
+    {
+        double s = 0.0;
+        for(int i = 0; i < width * height; ++i)
+        {
+            color d = data[i] - ref.data[i];
+            s += dot(d, d);
+        }
+        return s / (3.0 * width * height);
+    }
+
+    // FNV-1a over the raw pixel bits, equal only for bit-identical images
+    uint64_t checksum() const
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        size_t n = sizeof(color) * width * height;
+        for(size_t i = 0; i < n; ++i)
+        {
+            h ^= bytes[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
     void output(const std::string& filePath, bool gamma_correction = true, MAGIC_NUM type = MAGIC_NUM::P3) const
     {
         std::ofstream f(filePath, std::ios::out);
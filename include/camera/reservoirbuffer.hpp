@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include "math/vector.hpp"
+
+// a point on an emitter, what a reservoir of direct light keeps
+class light_point
+{
+public:
+    point p;
+    direction n;
+    color Le;
+};
+
+/*
+    weighted reservoir sampling: of a stream of candidates the one kept is each with probability
+    w / w_sum, M counts the candidates behind it and W is the unbiased contribution weight of the
+    kept one, 0 when it lights nothing
+*/
+class reservoir
+{
+public:
+    light_point y;
+    double w_sum;
+    double M;
+    double W;
+
+    reservoir() : w_sum(0.0), M(0.0), W(0.0) {}
+
+    // m candidates of total weight w, u uniform, true when x is kept
+    inline bool update(const light_point& x, double w, double m, double u)
+    {
+        w_sum += w;
+        M += m;
+        if(w > 0 && u * w_sum < w)
+        {
+            y = x;
+            return true;
+        }
+        return false;
+    }
+};
+
+/*
+    one reservoir per pixel, next to the FrameBuffer of the image they light
+    every pixel is written only by the thread that owns it, so no pixel needs a lock
+*/
+class ReservoirBuffer
+{
+private:
+    int width, height;
+    std::vector<reservoir> data;
+
+public:
+    ReservoirBuffer() : width(0), height(0) {}
+    ReservoirBuffer(int _w, int _h) : width(_w), height(_h), data(_w * _h) {}
+
+    inline int get_width() const { return width; }
+    inline int get_height() const { return height; }
+
+    void clear() { data.assign(width * height, reservoir()); }
+
+    inline reservoir& at(int row, int col) { return data[row * width + col]; }
+    inline const reservoir& at(int row, int col) const { return data[row * width + col]; }
+};
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include "math/vector.hpp"
+
+/*
+    image that any thread can add to, for contributions that land on another thread's pixels
+    channels are 32.32 fixed point atomics, integer addition is associative so the sum does not
+    depend on the order the threads arrive in and the image stays deterministic
+*/
+class SplatBuffer
+{
+private:
+    int width, height;
+    std::unique_ptr<std::atomic<int64_t>[]> data;
+
+    static constexpr double scale = 4294967296.0;       // 2^32
+    static constexpr double limit = 2147483647.0;       // largest single splat
+
+    static inline int64_t to_fixed(double v)
+    {
+        if(!(v == v)) return 0;
+        v = v < -limit ? -limit : (v > limit ? limit : v);
+        return (int64_t)std::llround(v * scale);
+    }
+
+public:
+    SplatBuffer(int _w, int _h) : width(_w), height(_h), data(new std::atomic<int64_t>[3 * _w * _h])
+    {
+        clear();
+    }
+
+    inline int get_width() const { return width; }
+    inline int get_height() const { return height; }
+
+    void clear()
+    {
+        for(int i = 0; i < 3 * width * height; ++i)
+            data[i].store(0, std::memory_order_relaxed);
+    }
+
+    inline void add(int row, int col, const color& c)
+    {
+        std::atomic<int64_t>* p = &data[3 * (row * width + col)];
+        p[0].fetch_add(to_fixed(c.x), std::memory_order_relaxed);
+        p[1].fetch_add(to_fixed(c.y), std::memory_order_relaxed);
+        p[2].fetch_add(to_fixed(c.z), std::memory_order_relaxed);
+    }
+
+    inline color get(int row, int col) const
+    {
+        const std::atomic<int64_t>* p = &data[3 * (row * width + col)];
+        return color(p[0].load(std::memory_order_relaxed) / scale,
+                     p[1].load(std::memory_order_relaxed) / scale,
+                     p[2].load(std::memory_order_relaxed) / scale);
+    }
+};
\ No newline at end of file
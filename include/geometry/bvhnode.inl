@@ -60,9 +60,9 @@ BVHnode::BVHnode(std::vector<std::shared_ptr<geometry> >& src_objects, int start
         right = std::make_shared<BVHnode>(src_objects, mid, end);
     }
 
+    // a single object has no right child
     AABB bleft = left->bounding_box();
-    AABB bright = right->bounding_box();
-    box = AABB(bleft, bright);
+    box = right ? AABB(bleft, right->bounding_box()) : bleft;
 }
 
 bool BVHnode::hit(const ray& r, hit_record& rec, interval t_interval) const
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "geometry.hpp"
+#include "pdf/alias_table.hpp"
+#include "material/texture.hpp"
+
+/*
+    light at infinity from an equirectangular radiance map: row 0 looks up (+y), the last row down,
+    column u is the angle phi = 2 pi u around y from +x toward +z, every texel piecewise constant
+
+    directions are sampled in O(1) from a piecewise_2d over the map, every texel weighted by its
+    luminance times sin theta, the solid angle it covers, so bright and large texels are picked most;
+    over solid angle the pdf is the map's over [0, 1)^2 divided by 2 pi^2 sin theta
+    with importance off the weight is sin theta alone, directions uniform over the sphere
+
+    it has no surface, so it is never in the BVH and never hit: a ray that hits nothing reads it
+    through environment(), and it sits in the light list, so light sampling and the MIS weights
+    pick it next to the area lights by pdf_value and random
+*/
+class environment_light : public geometry
+{
+private:
+    int width, height;
+    std::vector<color> texels;
+    piecewise_2d dist;
+
+    void build(bool importance);
+    int texel(const direction& dir, coord& uv) const;
+
+public:
+    // radiance an HDR image holds (any format stb_image reads), times scale, black when it cannot be read
+    environment_light(const std::string& path, double _scale = 1.0, bool _importance = true);
+    environment_light(int _w, int _h, std::vector<color> _texels, bool _importance = true);
+    // the same radiance from every direction
+    environment_light(const color& c);
+
+    virtual bool hit(const ray& /*r*/, hit_record& /*rec*/, interval /*t_interval*/ = interval(0.001, INF)) const override { return false; }
+    virtual AABB bounding_box() const override { return AABB(point(0, 0, 0), point(0, 0, 0)); }
+    virtual double pdf_value(const ray& r) const override;
+    virtual direction random(const point& o, sampler& s) const override;
+
+    virtual color environment(const direction& dir) const override;
+
+    inline int get_width() const { return width; }
+    inline int get_height() const { return height; }
+};
+
+#include "environment.inl"
\ No newline at end of file
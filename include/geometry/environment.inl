@@ -0,0 +1,83 @@
+environment_light::environment_light(const std::string& path, double _scale, bool _importance)
+{
+    int nchannel;
+    float* data = stbi_loadf(path.c_str(), &width, &height, &nchannel, 3);
+
+    if(!data)
+    {
+        std::cout << "Error: Could not load environment map '" << path << "'.\n";
+        width = height = 1;
+        texels.assign(1, color(0, 0, 0));
+    }
+    else
+    {
+        texels.resize(width * height);
+        for(int i = 0; i < width * height; ++i)
+            texels[i] = color(data[3 * i], data[3 * i + 1], data[3 * i + 2]) * _scale;
+        stbi_image_free(data);
+    }
+    build(_importance);
+}
+
+environment_light::environment_light(int _w, int _h, std::vector<color> _texels, bool _importance)
+    : width(_w), height(_h), texels(std::move(_texels))
+{
+    build(_importance);
+}
+
+environment_light::environment_light(const color& c) : width(1), height(1), texels(1, c)
+{
+    build(false);
+}
+
+void environment_light::build(bool importance)
+{
+    std::vector<double> f(width * height);
+    for(int v = 0; v < height; ++v)
+    {
+        double s = std::sin(PI * (v + 0.5) / height);
+        for(int u = 0; u < width; ++u)
+        {
+            const color& c = texels[v * width + u];
+            double y = 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+            f[v * width + u] = importance ? (y > 0 ? y : 0.0) * s : s;
+        }
+    }
+    dist = piecewise_2d(f, width, height);
+}
+
+int environment_light::texel(const direction& dir, coord& uv) const
+{
+    direction d = dir.normalize();
+    double phi = std::atan2(d.z, d.x);
+    if(phi < 0)
+        phi += 2 * PI;
+    uv = coord(phi / (2 * PI), std::acos(myclamp(d.y, -1.0, 1.0)) / PI);
+
+    int u = myclamp((int)(uv.x * width), 0, width - 1);
+    int v = myclamp((int)(uv.y * height), 0, height - 1);
+    return v * width + u;
+}
+
+double environment_light::pdf_value(const ray& r) const
+{
+    coord uv;
+    texel(r.get_dir(), uv);
+    double s = std::sin(PI * uv.y);
+    return s > 0 ? dist.pdf(uv) / (2 * PI * PI * s) : 0.0;
+}
+
+direction environment_light::random(const point& /*o*/, sampler& s) const
+{
+    double pdf;
+    coord uv = dist.sample(s.get_2d(), pdf);
+    double theta = PI * uv.y, phi = 2 * PI * uv.x;
+    double st = std::sin(theta);
+    return direction(st * std::cos(phi), std::cos(theta), st * std::sin(phi));
+}
+
+color environment_light::environment(const direction& dir) const
+{
+    coord uv;
+    return texels[texel(dir, uv)];
+}
\ No newline at end of file
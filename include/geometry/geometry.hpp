@@ -7,6 +7,7 @@
 #include "math/utility.hpp"
 #include "math/ray.hpp"
 #include "aabb.hpp"
+#include "sampler/sampler.hpp"
 
 class material;
 
@@ -38,11 +39,17 @@ public:
 
     // sample geometry to get pdf
     virtual double pdf_value(const ray& r) const { return 0.0; }
-    virtual direction random(const point& o) const { return point(0, 0, 0); }
+    virtual direction random(const point& o, sampler& s) const { return point(0, 0, 0); }
 
     // sample light surface
-    virtual point random_sample_surface() const { return point(0, 0, 0); }
+    virtual point random_sample_surface(sampler& s) const { return point(0, 0, 0); }
     virtual double area() const { return 0.0; };
+
+    // point uniform over the area, rec gets p, normal, material and uv, pdf_A is per unit area
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const { return false; }
+
+    // radiance from infinitely far along dir, seen by a ray that hits nothing, only lights at infinity have any
+    virtual color environment(const direction& dir) const { return color(0, 0, 0); }
 };
 
 
@@ -61,7 +68,10 @@ public:
     virtual bool hit(const ray& r, hit_record& rec, interval t_interval = interval(0.001, INF)) const override;
     virtual AABB bounding_box() const override;
     virtual double pdf_value(const ray& r) const override;
-    virtual direction random(const point& o) const override;
+    virtual direction random(const point& o, sampler& s) const override;
+
+    virtual double area() const override;
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const override;
 
 private:
     static coord get_sphere_uv(const point& p);
@@ -104,10 +114,11 @@ public:
     virtual bool hit(const ray& r, hit_record& rec, interval t_interval = interval(0.001, INF)) const override;
     virtual AABB bounding_box() const override;
     virtual double pdf_value(const ray& r) const override;
-    virtual direction random(const point& o) const override;
+    virtual direction random(const point& o, sampler& s) const override;
     
-    virtual point random_sample_surface() const override;
+    virtual point random_sample_surface(sampler& s) const override;
     virtual double area() const override;
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const override;
 };
 
 
@@ -127,7 +138,10 @@ public:
     virtual bool hit(const ray& r, hit_record& rec, interval t_interval = interval(0.001, INF)) const override;
     virtual AABB bounding_box() const override;
     virtual double pdf_value(const ray& r) const override;
-    virtual direction random(const point& o) const override;
+    virtual direction random(const point& o, sampler& s) const override;
+
+    virtual double area() const override;
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const override;
 };
 
 
@@ -147,10 +161,11 @@ public:
     virtual bool hit(const ray& r, hit_record& rec, interval t_interval = interval(0.001, INF)) const override;
     virtual AABB bounding_box() const override;
     virtual double pdf_value(const ray& r) const override;
-    virtual direction random(const point& o) const override;
+    virtual direction random(const point& o, sampler& s) const override;
 
-    virtual point random_sample_surface() const override;
+    virtual point random_sample_surface(sampler& s) const override;
     virtual double area() const override;
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const override;
 };
 
 
@@ -167,9 +182,14 @@ public:
     virtual bool hit(const ray& r, hit_record& rec, interval t_interval = interval(0.001, INF)) const override;
     virtual AABB bounding_box() const override;
     virtual double pdf_value(const ray& r) const override;
-    virtual direction random(const point& o) const override;
+    virtual direction random(const point& o, sampler& s) const override;
 
     virtual double area() const override;
+
+    // object picked with probability proportional to its area, so pdf_A = 1 / area()
+    virtual bool sample_surface(sampler& s, hit_record& rec, double& pdf_A) const override;
+
+    virtual color environment(const direction& dir) const override;
 };
 
 
@@ -49,11 +49,12 @@ double sphere::pdf_value(const ray& r) const
     return 1 / solid_angle;
 }
 
-direction sphere::random(const point& o) const
+direction sphere::random(const point& o, sampler& s) const
 {
     direction dir = center - o;
     
-    double r1 = random_double(), r2 = random_double();
+    coord u = s.get_2d();
+    double r1 = u.x, r2 = u.y;
     double z = 1 + r2 * (sqrt(1 - radius * radius / dot(dir, dir)) - 1);
     double phi = 2 * PI * r1;
     double x = cos(phi) * sqrt(1 - z * z);
@@ -66,6 +67,23 @@ direction sphere::random(const point& o) const
     return xdir * x + ydir * y + udir * z;
 }
 
+double sphere::area() const
+{
+    return 4 * PI * radius * radius;
+}
+
+bool sphere::sample_surface(sampler& s, hit_record& rec, double& pdf_A) const
+{
+    direction normal = sample_sphere_surface(s.get_2d());
+    rec.p = center + normal * radius;
+    rec.normal = normal;
+    rec.front_face = true;
+    rec.hit_mat = mat;
+    rec.uv = get_sphere_uv(normal);
+    pdf_A = 1.0 / area();
+    return true;
+}
+
 coord sphere::get_sphere_uv(const point& p)
 {
     double theta = acos(-p.y);
@@ -156,14 +174,15 @@ double yz_rect::pdf_value(const ray& r) const
     return distance_squared / (cosine * S);
 }
 
-direction yz_rect::random(const point& o) const
+direction yz_rect::random(const point& o, sampler& s) const
 {
-    return point(x, random_double(y0, y1), random_double(z0, z1)) - o;
+    return random_sample_surface(s) - o;
 }
 
-point yz_rect::random_sample_surface() const
+point yz_rect::random_sample_surface(sampler& s) const
 {
-    return point(x, random_double(y0, y1), random_double(z0, z1));
+    coord u = s.get_2d();
+    return point(x, y0 + (y1 - y0) * u.x, z0 + (z1 - z0) * u.y);
 }
 
 double yz_rect::area() const
@@ -171,6 +190,18 @@ double yz_rect::area() const
     return (y1 - y0) * (z1 - z0);
 }
 
+bool yz_rect::sample_surface(sampler& s, hit_record& rec, double& pdf_A) const
+{
+    coord u = s.get_2d();
+    rec.p = point(x, y0 + (y1 - y0) * u.x, z0 + (z1 - z0) * u.y);
+    rec.normal = direction(1, 0, 0);
+    rec.front_face = true;
+    rec.hit_mat = mat;
+    rec.uv = coord(u.y, u.x);
+    pdf_A = 1.0 / area();
+    return true;
+}
+
 bool xy_rect::hit(const ray& r, hit_record& rec, interval t_interval) const
 {
     point rori = r.get_ori();
@@ -211,9 +242,27 @@ double xy_rect::pdf_value(const ray& r) const
     return distance_squared / (cosine * S);
 }
 
-direction xy_rect::random(const point& o) const
+direction xy_rect::random(const point& o, sampler& s) const
+{
+    coord u = s.get_2d();
+    return point(x0 + (x1 - x0) * u.x, y0 + (y1 - y0) * u.y, z) - o;
+}
+
+double xy_rect::area() const
 {
-    return point(random_double(x0, x1), random_double(y0, y1), z) - o;
+    return (x1 - x0) * (y1 - y0);
+}
+
+bool xy_rect::sample_surface(sampler& s, hit_record& rec, double& pdf_A) const
+{
+    coord u = s.get_2d();
+    rec.p = point(x0 + (x1 - x0) * u.x, y0 + (y1 - y0) * u.y, z);
+    rec.normal = direction(0, 0, 1);
+    rec.front_face = true;
+    rec.hit_mat = mat;
+    rec.uv = u;
+    pdf_A = 1.0 / area();
+    return true;
 }
 
 bool xz_rect::hit(const ray& r, hit_record& rec, interval t_interval) const
@@ -256,14 +305,15 @@ double xz_rect::pdf_value(const ray& r) const
     return distance_squared / (cosine * S);
 }
 
-direction xz_rect::random(const point& o) const
+direction xz_rect::random(const point& o, sampler& s) const
 {
-    return point(random_double(x0, x1), y, random_double(z0, z1)) - o;
+    return random_sample_surface(s) - o;
 }
 
-point xz_rect::random_sample_surface() const
+point xz_rect::random_sample_surface(sampler& s) const
 {
-    return point(random_double(x0, x1), y, random_double(z0, z1));
+    coord u = s.get_2d();
+    return point(x0 + (x1 - x0) * u.x, y, z0 + (z1 - z0) * u.y);
 }
 
 double xz_rect::area() const
@@ -271,6 +321,18 @@ double xz_rect::area() const
     return (x1 - x0) * (z1 - z0);
 }
 
+bool xz_rect::sample_surface(sampler& s, hit_record& rec, double& pdf_A) const
+{
+    coord u = s.get_2d();
+    rec.p = point(x0 + (x1 - x0) * u.x, y, z0 + (z1 - z0) * u.y);
+    rec.normal = direction(0, 1, 0);
+    rec.front_face = true;
+    rec.hit_mat = mat;
+    rec.uv = u;
+    pdf_A = 1.0 / area();
+    return true;
+}
+
 bool geometry_list::hit(const ray& r, hit_record& rec, interval t_interval) const
 {
     hit_record tmp_rec;
@@ -314,9 +376,9 @@ double geometry_list::pdf_value(const ray& r) const
     return ans / objects.size();
 }
     
-direction geometry_list::random(const point& o) const
+direction geometry_list::random(const point& o, sampler& s) const
 {
-    return objects[random_int(0, objects.size() - 1)]->random(o);
+    return objects[s.get_int(0, objects.size() - 1)]->random(o, s);
 }
 
 double geometry_list::area() const
@@ -328,6 +390,35 @@ double geometry_list::area() const
     return S;
 }
 
+bool geometry_list::sample_surface(sampler& s, hit_record& rec, double& pdf_A) const
+{
+    double total = area();
+    if(objects.empty() || total <= 0)
+        return false;
+
+    double u = s.get_1d() * total;
+    int k = 0;
+    for(; k < (int)objects.size() - 1; ++k)
+    {
+        u -= objects[k]->area();
+        if(u < 0) break;
+    }
+
+    if(!objects[k]->sample_surface(s, rec, pdf_A))
+        return false;
+    pdf_A = 1.0 / total;
+    return true;
+}
+
+color geometry_list::environment(const direction& dir) const
+{
+    color L(0, 0, 0);
+    for(const auto& object : objects)
+        L = L + object->environment(dir);
+
+    return L;
+}
+
 box::box(point _m, point _M, std::shared_ptr<material> mat) : m(_m), M(_M)
 {
     faces.add(std::make_shared<xy_rect>(_m.z, _m.x, _M.x, _m.y, _M.y, mat));
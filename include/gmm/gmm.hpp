@@ -1,87 +1,198 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include "math/utility.hpp"
 #include "math/vector.hpp"
 #include "math/matrix.hpp"
+#include "parallel/threadpool.hpp"
+
+/*
+    e^x for x <= 0 and finite, to about 1e-13, and about 0 below -700
+    range reduction with the round-to-nearest magic number, a degree 11 polynomial and the exponent
+    built from the integer bits, no calls, no branches and no comparisons (those may trap, so the
+    compiler keeps them as branches), so the loops calling it vectorize
+*/
+inline double exp_neg(double x)
+{
+    const double magic = 6755399441055744.0;   // 1.5 * 2^52
+    // max(x, -700), u + |u| is exactly 0 for any u < 0
+    double u = x + 700.0;
+    x = 0.5 * (u + std::fabs(u)) - 700.0;
+
+    double t = x * 1.4426950408889634 + magic;
+    double n = t - magic;
+    double r = x - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10;
+
+    double p = 1.0 / 39916800;
+    p = p * r + 1.0 / 3628800;
+    p = p * r + 1.0 / 362880;
+    p = p * r + 1.0 / 40320;
+    p = p * r + 1.0 / 5040;
+    p = p * r + 1.0 / 720;
+    p = p * r + 1.0 / 120;
+    p = p * r + 1.0 / 24;
+    p = p * r + 1.0 / 6;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    // n sits in the low bits of t
+    int64_t bits, mbits;
+    std::memcpy(&bits, &t, 8);
+    std::memcpy(&mbits, &magic, 8);
+    int64_t e = (bits - mbits + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &e, 8);
+    return p * scale;
+}
 
 class Gaussian
 {
 private:
     vec2<double> miu;
     mat2<double> sigma;
+    mat2<double> precision;     // sigma inverse, cached whenever sigma changes
+    double norm;                // 1 / (2 pi sqrt(det sigma))
+
+    void update();
 
 public:
-    Gaussian() : miu(0.0, 0.0), sigma(1.0, 0.0, 0.0, 1.0) {}
-    Gaussian(const vec2<double>& m, const mat2<double>& s) : miu(m), sigma(s) {}
+    Gaussian() : miu(0.0, 0.0), sigma(1.0, 0.0, 0.0, 1.0), precision(1.0, 0.0, 0.0, 1.0), norm(1.0 / (2 * PI)) {}
+    Gaussian(const vec2<double>& m, const mat2<double>& s) : miu(m), sigma(s) { update(); }
 
     bool set_miu(const vec2<double>& m);
     bool set_cov(const mat2<double>& s);
     vec2<double> get_miu() const;
     mat2<double> get_cov() const;
-    double pdf(const vec2<double>& x);
+    double pdf(const vec2<double>& x) const;
+
+    // [0, 1)^2 to a point of this Gaussian, Box-Muller through the Cholesky factor
+    vec2<double> sample(const vec2<double>& u) const;
 
     void show() const;
 };
 
-class GMM
+/*
+    sufficient statistics of a weighted E-step over some samples, per component in SoA layout
+    second moments are raw (about the origin), so statistics of different steps can be blended
+*/
+class gmm_stats
 {
-private:
-    int ncomponent;
-    std::vector<double> weight;
-    std::vector<Gaussian> components;
+public:
+    double count;                       // samples
+    double w;                           // sum of w
+    std::vector<double> sum;            // sum of tau * w
+    std::vector<double> mx, my;         // sum of tau * w * x
+    std::vector<double> sxx, sxy, syy;  // sum of tau * w * x xT
 
-    int index;
-    double alpha;
-    std::vector<double> ss_sum;         // 1
-    std::vector<vec2<double> > ss_miu;  // x
-    std::vector<mat2<double> > ss_cov;  // x xT
+    std::vector<double> tau;            // scratch of the E-step kernel, kept between calls
 
-    static const int max_iter = 100;
-    static const int update = 10;
+    void reset(int ncomponent);
+    void add(const gmm_stats& s);
 
-    void Expectation(const std::vector<vec2<double> >& data, bool stepwise);
-    bool Maximization();
+    // this * (1 - a) + s * a, both per sample
+    void blend(const gmm_stats& s, double a);
+};
 
-public:
-    GMM() {}
-    GMM(int _n, double _a = 0.7) : ncomponent(_n), weight(_n, 1.0 / _n), components(_n), 
-                                index(0), alpha(_a), ss_sum(_n), ss_miu(_n), ss_cov(_n) {}
+/*
+    weighted GMM over the plane, components in SoA layout
+    every covariance change caches the precision, the Cholesky factor and the log of
+    weight / (2 pi sqrt(det)), so the E-step is a quadratic form and an exp per sample and component
 
-    void offline_trainModel(const std::vector<vec2<double> >& data);
-    void online_trainModel(const vec2<double>& data);
-    void show() const;
-};
+    the E-step runs over blocks of samples: log terms component by component, a log-sum-exp over the
+    components of every sample (nothing underflows to 0 / 0 far from the mixture), then the statistics,
+    every inner loop is over the samples of the block with no calls and no branches, so they vectorize
 
-// weighted GMM
+    a large E-step is a map-reduce: statistics of every chunk of samples on their own, a task each when
+    there is a pool, then summed in chunk order, so the model is the same with or without the pool
+*/
 class WGMM
 {
 private:
     int ncomponent;
     std::vector<double> weight;
-    std::vector<Gaussian> components;
+    std::vector<double> mx, my;             // mean
+    std::vector<double> cxx, cxy, cyy;      // covariance
+    std::vector<double> pxx, pxy, pyy;      // precision
+    std::vector<double> lxx, lyx, lyy;      // covariance = L LT
+    std::vector<double> logc;               // log(weight / (2 pi sqrt(det))), finite
 
     int index;
     double alpha;
-    std::vector<double> ss_w;           // weight
-    std::vector<double> ss_sum;         // 1
-    std::vector<vec2<double> > ss_miu;  // x
-    std::vector<mat2<double> > ss_cov;  // x xT
+    gmm_stats ss;                           // running, per sample
+    gmm_stats step;                         // of the last E-step
+    std::vector<gmm_stats> parts;           // of every chunk of the last E-step
 
     static const int max_iter = 100;
     static const int update = 10;
+    static const int block = 256;           // samples per kernel pass, bounds the scratch
+    static constexpr double ridge = 1e-3;   // added to every covariance, so a component that caught a few close points does not collapse
+
+    // return convergence? as Gaussian::set_miu and set_cov
+    bool set_component(int j, const vec2<double>& m, const mat2<double>& s);
+    void update_constants(int j);
 
-    void Expectation(const std::vector<vec2<double> >& data, const std::vector<double>& w, bool stepwise);
+    void Expectation(const double* x, const double* y, const double* w, int n, double a, thread_pool* pool = nullptr);
     bool Maximization();
 
 public:
-    WGMM() {}
-    WGMM(int _n, double _a = 0.7) : ncomponent(_n), weight(_n, 1.0 / _n), components(_n),
-                                index(0), alpha(_a), ss_w(_n), ss_sum(_n), ss_miu(_n), ss_cov(_n) {}
+    static const int chunk = 4096;          // samples per task of a large E-step
 
-    void offline_trainModel(const std::vector<vec2<double> >& data, const std::vector<double>& w);
+    WGMM() : ncomponent(0), index(0), alpha(0.7) {}
+    WGMM(int _n, double _a = 0.7);
+
+    /*
+        E-step statistics of n samples under the current parameters, added to out
+        x, y, w are arrays of n, w == nullptr weighs every sample 1
+    */
+    void accumulate(const double* x, const double* y, const double* w, int n, gmm_stats& out) const;
+
+    void offline_trainModel(const std::vector<vec2<double> >& data, const std::vector<double>& w, thread_pool* pool = nullptr);
+    // the E-steps run on the pool when there is one, which must not be running this call as one of its tasks
+    void offline_trainModel(const double* x, const double* y, const double* w, int n, thread_pool* pool = nullptr);
     void online_trainModel(const vec2<double>& data, double w);
+
+    // one stepwise update for n samples, with the share of the statistics they would get one at a time
+    void online_trainModel(const double* x, const double* y, const double* w, int n);
+
+    void show() const;
+
+    /*
+        weights, means, covariances and how far the stepwise EM went, as raw bytes
+        read rebuilds the statistics the parameters came from, so online training goes on after it
+    */
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+    inline int size() const { return ncomponent; }
+    Gaussian component(int j) const;
+    inline double component_weight(int j) const { return weight[j]; }
+
+    double pdf(const vec2<double>& x) const;
+
+    // u picks the component, u2 the point in it
+    vec2<double> sample(double u, const vec2<double>& u2) const;
+};
+
+// GMM with every sample weighing 1
+class GMM
+{
+private:
+    WGMM model;
+
+public:
+    GMM() {}
+    GMM(int _n, double _a = 0.7) : model(_n, _a) {}
+
+    void offline_trainModel(const std::vector<vec2<double> >& data, thread_pool* pool = nullptr);
+    void online_trainModel(const vec2<double>& data);
+    void online_trainModel(const double* x, const double* y, int n);
     void show() const;
+
+    inline double pdf(const vec2<double>& x) const { return model.pdf(x); }
 };
 
 #include "gmm.inl"
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "gmm.hpp"
 
+void Gaussian::update()
+{
+    precision = sigma.inverse();
+    norm = 1.0 / (2 * PI * sqrt(sigma.determinant()));
+}
+
 // return convergence?
 bool Gaussian::set_miu(const vec2<double>& m)
 {
@@ -19,6 +25,7 @@ bool Gaussian::set_cov(const mat2<double>& s)
     if((p[0][0] * p[0][0] + p[0][1] * p[0][1] + p[1][0] * p[1][0] + p[1][1] * p[1][1]) < EPS)
         return true;
     sigma = s;
+    update();
     return false;
 }
 
@@ -38,234 +45,295 @@ void Gaussian::show() const
     std::cout << sigma << std::endl;
 }
 
-double Gaussian::pdf(const vec2<double>& x)
+double Gaussian::pdf(const vec2<double>& x) const
 {
-    double sigAbs = sigma.determinant();
-    
     vec2<double> x_miu = x - miu;
-    mat2<double> inv_sigma = sigma.inverse();
-    double t = dot(x_miu, inv_sigma * x_miu);
+    double t = dot(x_miu, precision * x_miu);
 
-    return 1.0 / (2 * PI * sqrt(sigAbs)) * exp(-0.5 * t);
+    return norm * exp(-0.5 * t);
 }
 
-void GMM::Expectation(const std::vector<vec2<double> >& data, bool stepwise)
+vec2<double> Gaussian::sample(const vec2<double>& u) const
 {
-    int n = data.size();
-
-    std::vector<std::vector<double> > tau(ncomponent);
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        for(int k = 0; k < n; ++k)
-            tau[j].push_back(weight[j] * components[j].pdf(data[k]));
-    }
-
-    for(int k = 0; k < n; ++k)
-    {
-        double s = 0.0;
-        for(int j = 0; j < ncomponent; ++j)
-            s += tau[j][k];
+    double r = sqrt(-2 * log(fmax(1 - u.x, 1e-300)));
+    double phi = 2 * PI * u.y;
+    double z0 = r * cos(phi), z1 = r * sin(phi);
 
-        for(int j = 0; j < ncomponent; ++j)
-            tau[j][k] /= s;
-    }
+    // sigma = L LT, L lower triangular
+    vec2<double> r0 = sigma.row(0), r1 = sigma.row(1);
+    double l00 = sqrt(r0.x);
+    double l10 = r1.x / l00;
+    double l11 = sqrt(fmax(r1.y - l10 * l10, 0.0));
 
-    double a = stepwise ? pow(index, -alpha) : 1.0;
+    return vec2<double>(miu.x + l00 * z0, miu.y + l10 * z0 + l11 * z1);
+}
 
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        double sum = 0.0;
-        for(int k = 0; k < n; ++k)
-            sum += tau[j][k];
-        ss_sum[j] = ss_sum[j] * (1.0 - a) + sum / n * a;
-    }
 
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        vec2<double> m(0.0);
-        for(int k = 0; k < n; ++k)
-            m = m + data[k] * tau[j][k];
-        ss_miu[j] = ss_miu[j] * (1.0 - a) + m / n * a;
-    }
 
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        mat2<double> s(0.0, 0.0, 0.0, 0.0);
-        for(int k = 0; k < n; ++k)
-        {
-            vec2<double> d = data[k] - components[j].get_miu();
-            s = s + mat2<double>(d.x * d.x, d.x * d.y, d.y * d.x, d.y * d.y) * tau[j][k];
-        }
-        ss_cov[j] = ss_cov[j] * (1.0 - a) + s / n * a;
-    }
+void gmm_stats::reset(int ncomponent)
+{
+    count = 0.0, w = 0.0;
+    sum.assign(ncomponent, 0.0);
+    mx.assign(ncomponent, 0.0), my.assign(ncomponent, 0.0);
+    sxx.assign(ncomponent, 0.0), sxy.assign(ncomponent, 0.0), syy.assign(ncomponent, 0.0);
 }
 
-// return convergence?
-bool GMM::Maximization()
+void gmm_stats::add(const gmm_stats& s)
 {
-    bool miu_conv = true, cov_conv = true;
-    for(int j = 0; j < ncomponent; ++j)
+    count += s.count, w += s.w;
+    for(int j = 0; j < (int)sum.size(); ++j)
     {
-        weight[j] = ss_sum[j];
-        miu_conv &= components[j].set_miu(ss_miu[j] / ss_sum[j]);
-        cov_conv &= components[j].set_cov(ss_cov[j] / ss_sum[j]);
+        sum[j] += s.sum[j];
+        mx[j] += s.mx[j], my[j] += s.my[j];
+        sxx[j] += s.sxx[j], sxy[j] += s.sxy[j], syy[j] += s.syy[j];
     }
-    return miu_conv & cov_conv;
 }
 
-void GMM::offline_trainModel(const std::vector<vec2<double> >& data)
+void gmm_stats::blend(const gmm_stats& s, double a)
 {
-    int n = data.size();
-
-    // init miu
-    vec2<double> M(-INF), m(INF);
-    for(int k = 0; k < n; ++k)
+    double b = s.count > 0 ? a / s.count : 0.0;
+    w = w * (1 - a) + s.w * b;
+    for(int j = 0; j < (int)sum.size(); ++j)
     {
-        M.x = M.x > data[k].x ? M.x : data[k].x;
-        M.y = M.y > data[k].y ? M.y : data[k].y;
-        m.x = m.x < data[k].x ? m.x : data[k].x;
-        m.y = m.y < data[k].y ? m.y : data[k].y;
-    }
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        double p = (double)j / ncomponent;
-        components[j].set_miu(M * p + m * (1 - p));
+        sum[j] = sum[j] * (1 - a) + s.sum[j] * b;
+        mx[j] = mx[j] * (1 - a) + s.mx[j] * b;
+        my[j] = my[j] * (1 - a) + s.my[j] * b;
+        sxx[j] = sxx[j] * (1 - a) + s.sxx[j] * b;
+        sxy[j] = sxy[j] * (1 - a) + s.sxy[j] * b;
+        syy[j] = syy[j] * (1 - a) + s.syy[j] * b;
     }
+}
 
-    // EM algorithm
-    for(int i = 0; i < max_iter; ++i)
-    {
-        // E step
-        Expectation(data, false);
 
-        // M step
-        bool convergence = Maximization();
 
-        if(convergence) break;
-    }
-    index = n;
+WGMM::WGMM(int _n, double _a)
+    : ncomponent(_n), weight(_n, 1.0 / _n), mx(_n, 0.0), my(_n, 0.0), cxx(_n, 1.0), cxy(_n, 0.0), cyy(_n, 1.0),
+      pxx(_n, 1.0), pxy(_n, 0.0), pyy(_n, 1.0), lxx(_n, 1.0), lyx(_n, 0.0), lyy(_n, 1.0), logc(_n),
+      index(0), alpha(_a)
+{
+    for(int j = 0; j < ncomponent; ++j)
+        update_constants(j);
+    ss.reset(ncomponent);
+    step.reset(ncomponent);
 }
 
-void GMM::online_trainModel(const vec2<double>& data)
+void WGMM::update_constants(int j)
 {
-    // E step
-    std::vector<vec2<double> > d {data};
-    Expectation(d, true);
+    double det = cxx[j] * cyy[j] - cxy[j] * cxy[j];
+    pxx[j] = cyy[j] / det, pxy[j] = -cxy[j] / det, pyy[j] = cxx[j] / det;
 
-    // M step
-    index++;
+    lxx[j] = sqrt(cxx[j]);
+    lyx[j] = cxy[j] / lxx[j];
+    lyy[j] = sqrt(fmax(cyy[j] - lyx[j] * lyx[j], 0.0));
 
-    if(index % update == 0)
-        Maximization();
+    // a finite floor, so log terms stay finite for exp_neg
+    logc[j] = weight[j] > 0 ? log(weight[j] / (2 * PI * sqrt(det))) : -1e300;
 }
 
-void GMM::show() const
+bool WGMM::set_component(int j, const vec2<double>& m, const mat2<double>& s)
 {
-    std::cout << "There are " << ncomponent << " components.\n" << std::endl;
-
-    for(int i = 0; i < ncomponent; ++i)
+    vec2<double> d = vec2<double>(mx[j], my[j]) - m;
+    bool miu_conv = d.length_square() < EPS;
+    if(!miu_conv)
+        mx[j] = m.x, my[j] = m.y;
+
+    vec2<double> r0 = s.row(0), r1 = s.row(1);
+    bool cov_conv = false;
+    if(s.determinant() > 0.0)
     {
-        std::cout << "Component " << i << ": weight " << weight[i] << std::endl;
-        components[i].show();
+        double a = cxx[j] - r0.x, b = cxy[j] - r0.y, c = cxy[j] - r1.x, e = cyy[j] - r1.y;
+        cov_conv = a * a + b * b + c * c + e * e < EPS;
+        if(!cov_conv)
+            cxx[j] = r0.x, cxy[j] = 0.5 * (r0.y + r1.x), cyy[j] = r1.y;
     }
+    return miu_conv && cov_conv;
 }
 
-
-void WGMM::Expectation(const std::vector<vec2<double> >& data, const std::vector<double>& w, bool stepwise)
+void WGMM::accumulate(const double* x, const double* y, const double* w, int n, gmm_stats& out) const
 {
-    int n = data.size();
-
-    std::vector<std::vector<double> > tau(ncomponent);
-    for(int j = 0; j < ncomponent; ++j)
+    const int K = ncomponent;
+    out.tau.resize((size_t)K * block);
+    double* tau = out.tau.data();
+
+    // every pass works on local copies padded with samples of weight 0 to whole groups of 4, so the
+    // loops step by groups with no remainder and nothing aliases the scratch
+    double bx[block], by[block], bw[block], top[block], r[block];
+    for(int s = 0; s < n; s += block)
     {
-        for(int k = 0; k < n; ++k)
-            tau[j].push_back(weight[j] * components[j].pdf(data[k]));
-    }
+        const int b = std::min(block, n - s);
+        const int groups = (b + 3) / 4;
+        double wsum = 0.0;
+        for(int k = 0; k < b; ++k)
+        {
+            bx[k] = x[s + k], by[k] = y[s + k];
+            bw[k] = w ? w[s + k] : 1.0;
+            wsum += bw[k];
+        }
+        for(int k = b; k < groups * 4; ++k)
+            bx[k] = by[k] = bw[k] = 0.0;
+        out.count += b;
+        out.w += wsum;
 
-    for(int k = 0; k < n; ++k)
-    {
-        double s = 0.0;
-        for(int j = 0; j < ncomponent; ++j)
-            s += tau[j][k];
+        // log of weight * density, component by component
+        for(int j = 0; j < K; ++j)
+        {
+            double* t = tau + j * block;
+            const double c = logc[j], ux = mx[j], uy = my[j];
+            const double qxx = 0.5 * pxx[j], qxy = pxy[j], qyy = 0.5 * pyy[j];
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    double dx = bx[k] - ux, dy = by[k] - uy;
+                    t[k] = c - (qxx * dx * dx + qxy * dx * dy + qyy * dy * dy);
+                }
+        }
 
-        for(int j = 0; j < ncomponent; ++j)
-            tau[j][k] /= s;
-    }
+        // log-sum-exp over the components, the largest term of a sample is e^0
+        for(int g = 0; g < groups; ++g)
+            for(int l = 0; l < 4; ++l)
+                top[4 * g + l] = tau[4 * g + l], r[4 * g + l] = 0.0;
+        for(int j = 1; j < K; ++j)
+        {
+            const double* t = tau + j * block;
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    top[k] = t[k] > top[k] ? t[k] : top[k];
+                }
+        }
+        for(int j = 0; j < K; ++j)
+        {
+            double* t = tau + j * block;
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    t[k] = exp_neg(t[k] - top[k]);
+                    r[k] += t[k];
+                }
+        }
 
-    double a = stepwise ? pow(index, -alpha) : 1.0;
+        // w / sum, so tau * r is the weighted responsibility
+        for(int g = 0; g < groups; ++g)
+            for(int l = 0; l < 4; ++l)
+                r[4 * g + l] = bw[4 * g + l] / r[4 * g + l];
 
-    for(int j = 0; j < ncomponent; ++j)
-    {
-        double ww = 0.0;
-        for(int k = 0; k < n; ++k)
-            ww += w[k];
-        ss_w[j] = ss_w[j] * (1.0 - a) + ww / n * a;
+        // four lanes per sum keep the reductions in a fixed order, and vectorizable
+        for(int j = 0; j < K; ++j)
+        {
+            const double* t = tau + j * block;
+            double a[4] = {}, ax[4] = {}, ay[4] = {}, axx[4] = {}, axy[4] = {}, ayy[4] = {};
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    double v = t[k] * r[k], px = bx[k], py = by[k];
+                    a[l] += v;
+                    ax[l] += v * px, ay[l] += v * py;
+                    axx[l] += v * px * px, axy[l] += v * px * py, ayy[l] += v * py * py;
+                }
+
+            out.sum[j] += (a[0] + a[1]) + (a[2] + a[3]);
+            out.mx[j] += (ax[0] + ax[1]) + (ax[2] + ax[3]);
+            out.my[j] += (ay[0] + ay[1]) + (ay[2] + ay[3]);
+            out.sxx[j] += (axx[0] + axx[1]) + (axx[2] + axx[3]);
+            out.sxy[j] += (axy[0] + axy[1]) + (axy[2] + axy[3]);
+            out.syy[j] += (ayy[0] + ayy[1]) + (ayy[2] + ayy[3]);
+        }
     }
+}
 
-    for(int j = 0; j < ncomponent; ++j)
+void WGMM::Expectation(const double* x, const double* y, const double* w, int n, double a, thread_pool* pool)
+{
+    step.reset(ncomponent);
+    const int nchunk = (n + chunk - 1) / chunk;
+    if(nchunk <= 1)
+        accumulate(x, y, w, n, step);
+    else
     {
-        double sum = 0.0;
-        for(int k = 0; k < n; ++k)
-            sum += tau[j][k] * w[k];
-        ss_sum[j] = ss_sum[j] * (1.0 - a) + sum / n * a;
+        // map: the statistics of every chunk, reduce: their sum in chunk order
+        if((int)parts.size() < nchunk)
+            parts.resize(nchunk);
+        auto map = [&](int c, int) {
+            const int s = c * chunk, b = std::min(chunk, n - s);
+            parts[c].reset(ncomponent);
+            accumulate(x + s, y + s, w ? w + s : nullptr, b, parts[c]);
+        };
+        if(pool)
+            pool->parallel_for(nchunk, map);
+        else
+            for(int c = 0; c < nchunk; ++c)
+                map(c, 0);
+
+        for(int c = 0; c < nchunk; ++c)
+            step.add(parts[c]);
     }
+    ss.blend(step, a);
+}
 
+bool WGMM::Maximization()
+{
+    bool convergence = true;
     for(int j = 0; j < ncomponent; ++j)
     {
-        vec2<double> m(0.0);
-        for(int k = 0; k < n; ++k)
-            m = m + data[k] * (tau[j][k] * w[k]);
-        ss_miu[j] = ss_miu[j] * (1.0 - a) + m / n * a;
+        weight[j] = ss.w > 0 ? ss.sum[j] / ss.w : 0.0;
+        if(ss.sum[j] <= 0)
+            continue;
+
+        vec2<double> m(ss.mx[j] / ss.sum[j], ss.my[j] / ss.sum[j]);
+        mat2<double> s(ss.sxx[j] / ss.sum[j] - m.x * m.x + ridge, ss.sxy[j] / ss.sum[j] - m.x * m.y,
+                       ss.sxy[j] / ss.sum[j] - m.x * m.y, ss.syy[j] / ss.sum[j] - m.y * m.y + ridge);
+        convergence &= set_component(j, m, s);
     }
 
+    double total = 0.0;
     for(int j = 0; j < ncomponent; ++j)
-    {
-        mat2<double> s(0.0, 0.0, 0.0, 0.0);
-        for(int k = 0; k < n; ++k)
-        {
-            vec2<double> d = data[k] - components[j].get_miu();
-            s = s + mat2<double>(d.x * d.x, d.x * d.y, d.y * d.x, d.y * d.y) * (tau[j][k] * w[k]);
-        }
-        ss_cov[j] = ss_cov[j] * (1.0 - a) + s / n * a;
-    }
-}
-
-bool WGMM::Maximization()
-{
-    bool miu_conv = true, cov_conv = true;
+        total += weight[j];
     for(int j = 0; j < ncomponent; ++j)
     {
-        weight[j] = ss_sum[j] / ss_w[j];
-        miu_conv &= components[j].set_miu(ss_miu[j] / ss_sum[j]);
-        cov_conv &= components[j].set_cov(ss_cov[j] / ss_sum[j]);
+        if(total > 0)
+            weight[j] /= total;
+        update_constants(j);
     }
-    return miu_conv & cov_conv;
+
+    return convergence;
 }
 
-void WGMM::offline_trainModel(const std::vector<vec2<double> >& data, const std::vector<double>& w)
+void WGMM::offline_trainModel(const std::vector<vec2<double> >& data, const std::vector<double>& w, thread_pool* pool)
 {
     int n = data.size();
+    std::vector<double> x(n), y(n);
+    for(int k = 0; k < n; ++k)
+        x[k] = data[k].x, y[k] = data[k].y;
+    offline_trainModel(x.data(), y.data(), w.data(), n, pool);
+}
 
+void WGMM::offline_trainModel(const double* x, const double* y, const double* w, int n, thread_pool* pool)
+{
     // init miu
     vec2<double> M(-INF), m(INF);
     for(int k = 0; k < n; ++k)
     {
-        M.x = M.x > data[k].x ? M.x : data[k].x;
-        M.y = M.y > data[k].y ? M.y : data[k].y;
-        m.x = m.x < data[k].x ? m.x : data[k].x;
-        m.y = m.y < data[k].y ? m.y : data[k].y;
+        M.x = M.x > x[k] ? M.x : x[k];
+        M.y = M.y > y[k] ? M.y : y[k];
+        m.x = m.x < x[k] ? m.x : x[k];
+        m.y = m.y < y[k] ? m.y : y[k];
     }
     for(int j = 0; j < ncomponent; ++j)
     {
         double p = (double)j / ncomponent;
-        components[j].set_miu(M * p + m * (1 - p));
+        vec2<double> c = M * p + m * (1 - p);
+        mx[j] = c.x, my[j] = c.y;
+        update_constants(j);
     }
 
     // EM algorithm
     for(int i = 0; i < max_iter; ++i)
     {
         // E step
-        Expectation(data, w, false);
+        Expectation(x, y, w, n, 1.0, pool);
 
         // M step
         bool convergence = Maximization();
@@ -273,22 +341,108 @@ void WGMM::offline_trainModel(const std::vector<vec2<double> >& data, const std:
         if(convergence) break;
     }
     index = n;
+    parts.clear();
+    parts.shrink_to_fit();
 }
 
 void WGMM::online_trainModel(const vec2<double>& data, double w)
 {
+    online_trainModel(&data.x, &data.y, &w, 1);
+}
+
+void WGMM::online_trainModel(const double* x, const double* y, const double* w, int n)
+{
+    if(n <= 0)
+        return;
+
+    // sample i alone would keep 1 - (index + i)^-alpha of the statistics
+    double keep = 1.0;
+    for(int i = 0; i < n; ++i)
+        keep *= index + i > 0 ? 1.0 - pow(index + i, -alpha) : 0.0;
+
     // E step
-    std::vector<vec2<double> > d {data};
-    std::vector<double> ww {w};
-    Expectation(d, ww, true);
+    Expectation(x, y, w, n, 1.0 - keep);
 
     // M step
-    index++;
+    int before = index;
+    index += n;
 
-    if(index % update == 0)
+    if(index / update != before / update)
         Maximization();
 }
 
+Gaussian WGMM::component(int j) const
+{
+    return Gaussian(vec2<double>(mx[j], my[j]), mat2<double>(cxx[j], cxy[j], cxy[j], cyy[j]));
+}
+
+double WGMM::pdf(const vec2<double>& x) const
+{
+    double p = 0.0;
+    for(int j = 0; j < ncomponent; ++j)
+    {
+        double dx = x.x - mx[j], dy = x.y - my[j];
+        p += exp(logc[j] - 0.5 * (pxx[j] * dx * dx + 2 * pxy[j] * dx * dy + pyy[j] * dy * dy));
+    }
+    return p;
+}
+
+vec2<double> WGMM::sample(double u, const vec2<double>& u2) const
+{
+    int j = 0;
+    double c = weight[0];
+    while(j + 1 < ncomponent && u >= c)
+        c += weight[++j];
+
+    double r = sqrt(-2 * log(fmax(1 - u2.x, 1e-300)));
+    double phi = 2 * PI * u2.y;
+    double z0 = r * cos(phi), z1 = r * sin(phi);
+
+    return vec2<double>(mx[j] + lxx[j] * z0, my[j] + lyx[j] * z0 + lyy[j] * z1);
+}
+
+void WGMM::write(std::ostream& out) const
+{
+    write_raw(out, ncomponent);
+    write_raw(out, index);
+    write_raw(out, ss.w);
+    for(int j = 0; j < ncomponent; ++j)
+        for(double v : { weight[j], mx[j], my[j], cxx[j], cxy[j], cyy[j] })
+            write_raw(out, v);
+}
+
+bool WGMM::read(std::istream& in)
+{
+    int n, idx;
+    double w;
+    if(!read_raw(in, n) || !read_raw(in, idx) || !read_raw(in, w) || n <= 0 || n > 1024)
+        return false;
+
+    WGMM g(n, alpha);
+    g.index = idx;
+    g.ss.w = w;
+    for(int j = 0; j < n; ++j)
+    {
+        double* v[] = { &g.weight[j], &g.mx[j], &g.my[j], &g.cxx[j], &g.cxy[j], &g.cyy[j] };
+        for(double* p : v)
+            if(!read_raw(in, *p) || !std::isfinite(*p))
+                return false;
+        if(g.cxx[j] * g.cyy[j] - g.cxy[j] * g.cxy[j] <= 0)
+            return false;
+        g.update_constants(j);
+
+        // the statistics Maximization would have made these of
+        double s = g.weight[j] * w;
+        g.ss.sum[j] = s;
+        g.ss.mx[j] = s * g.mx[j], g.ss.my[j] = s * g.my[j];
+        g.ss.sxx[j] = s * (g.cxx[j] - ridge + g.mx[j] * g.mx[j]);
+        g.ss.sxy[j] = s * (g.cxy[j] + g.mx[j] * g.my[j]);
+        g.ss.syy[j] = s * (g.cyy[j] - ridge + g.my[j] * g.my[j]);
+    }
+    *this = std::move(g);
+    return true;
+}
+
 void WGMM::show() const
 {
     std::cout << "There are " << ncomponent << " components.\n" << std::endl;
@@ -296,6 +450,32 @@ void WGMM::show() const
     for(int i = 0; i < ncomponent; ++i)
     {
         std::cout << "Component " << i << ": weight " << weight[i] << std::endl;
-        components[i].show();
+        component(i).show();
     }
+}
+
+
+
+void GMM::offline_trainModel(const std::vector<vec2<double> >& data, thread_pool* pool)
+{
+    int n = data.size();
+    std::vector<double> x(n), y(n);
+    for(int k = 0; k < n; ++k)
+        x[k] = data[k].x, y[k] = data[k].y;
+    model.offline_trainModel(x.data(), y.data(), nullptr, n, pool);
+}
+
+void GMM::online_trainModel(const vec2<double>& data)
+{
+    model.online_trainModel(&data.x, &data.y, nullptr, 1);
+}
+
+void GMM::online_trainModel(const double* x, const double* y, int n)
+{
+    model.online_trainModel(x, y, nullptr, n);
+}
+
+void GMM::show() const
+{
+    model.show();
 }
\ No newline at end of file
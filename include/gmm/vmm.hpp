@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "math/utility.hpp"
+#include "math/vector.hpp"
+#include "gmm.hpp"
+
+// kappa / (2 pi (1 - e^-2kappa)), the density of a vMF lobe at its mean over e^(kappa (cos - 1)), 1 / 4pi at 0
+inline double vmf_norm(double kappa)
+{
+    return kappa < 1e-6 ? 1 / (4 * PI) : kappa / (2 * PI * -std::expm1(-2 * kappa));
+}
+
+// a weighted von Mises-Fisher lobe, density weight * vmf_norm(kappa) * e^(kappa (mu . w - 1)) over the sphere
+class vmf_lobe
+{
+public:
+    direction mu;
+    double kappa;
+    double weight;
+
+    // w of unit length
+    inline double pdf(const direction& w) const { return weight * vmf_norm(kappa) * std::exp(kappa * (dot(mu, w) - 1)); }
+
+    // [0, 1)^2 to a direction of this lobe, the cosine to mu by inversion, then around mu
+    direction sample(const vec2<double>& u) const;
+};
+
+/*
+    sufficient statistics of a weighted E-step of a VMM, per component
+    the sums of tau * w * direction give both the mean direction and, by their length, kappa
+*/
+class vmm_stats
+{
+public:
+    double count;
+    double w;
+    std::vector<double> sum;
+    std::vector<double> rx, ry, rz;
+
+    std::vector<double> tau;
+
+    void reset(int ncomponent);
+    void add(const vmm_stats& s);
+    void blend(const vmm_stats& s, double a);
+};
+
+/*
+    weighted mixture of von Mises-Fisher lobes over the sphere, components in SoA layout
+    a guiding distribution with no warp: the E-step term of a sample is a dot product and an exp,
+    the product with a cosine lobe is again a mixture, in closed form, and sampling a lobe is one log
+
+    EM as WGMM: offline from lobes spread over the sphere, or stepwise online, the E-step over blocks
+    of samples with a log-sum-exp over the components; the M-step takes kappa from the mean resultant
+    length r by Banerjee et al.'s r (3 - r^2) / (1 - r^2)
+*/
+class VMM
+{
+private:
+    int ncomponent;
+    std::vector<double> weight;
+    std::vector<double> mx, my, mz;     // mean direction
+    std::vector<double> kappa;
+    std::vector<double> logc;           // log(weight * vmf_norm(kappa)) - kappa, finite
+
+    int index;
+    double alpha;
+    vmm_stats ss;
+    vmm_stats step;
+
+    static const int max_iter = 100;
+    static const int update = 10;
+    static const int block = 256;
+    static constexpr double max_kappa = 1e4;
+
+    void update_constants(int j);
+    void Expectation(const double* x, const double* y, const double* z, const double* w, int n, double a);
+    bool Maximization();
+
+public:
+    static const int max_components = 16;
+
+    VMM() : ncomponent(0), index(0), alpha(0.7) {}
+    VMM(int _n, double _a = 0.7);
+
+    // E-step statistics of n unit directions (x, y, z) under the current parameters, added to out
+    void accumulate(const double* x, const double* y, const double* z, const double* w, int n, vmm_stats& out) const;
+
+    void offline_trainModel(const double* x, const double* y, const double* z, const double* w, int n);
+    void online_trainModel(const direction& data, double w);
+    void online_trainModel(const double* x, const double* y, const double* z, const double* w, int n);
+
+    void show() const;
+
+    // as WGMM::write and read, the mean resultant length read rebuilds is coth(kappa) - 1 / kappa
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+    inline int size() const { return ncomponent; }
+    vmf_lobe component(int j) const;
+
+    // dir of unit length
+    double pdf(const direction& dir) const;
+    direction sample(double u, const vec2<double>& u2) const;
+
+    /*
+        the mixture times a vMF lobe of axis n, normalized, into out[0, size())
+        a clamped cosine around the normal is about the lobe of kappa 2.18
+    */
+    void product(const direction& n, double kappa_n, vmf_lobe* out) const;
+};
+
+#include "vmm.inl"
\ No newline at end of file
@@ -0,0 +1,331 @@
+#include "vmm.hpp"
+
+direction vmf_lobe::sample(const vec2<double>& u) const
+{
+    // cosine to mu: 1 + log(1 - (1 - u) (1 - e^-2kappa)) / kappa
+    double c = kappa < 1e-6 ? 1 - 2 * u.x : 1 + std::log1p((1 - u.x) * std::expm1(-2 * kappa)) / kappa;
+    c = fmax(-1.0, fmin(1.0, c));
+    double s = sqrt(fmax(0.0, 1 - c * c));
+    double phi = 2 * PI * u.y;
+
+    // a frame around mu with no branch on its direction (Duff et al. 2017)
+    double sign = std::copysign(1.0, mu.z);
+    double a = -1 / (sign + mu.z), b = mu.x * mu.y * a;
+    direction t1(1 + sign * mu.x * mu.x * a, sign * b, -sign * mu.x);
+    direction t2(b, sign + mu.y * mu.y * a, -mu.y);
+
+    return t1 * (s * cos(phi)) + t2 * (s * sin(phi)) + mu * c;
+}
+
+
+
+void vmm_stats::reset(int ncomponent)
+{
+    count = 0.0, w = 0.0;
+    sum.assign(ncomponent, 0.0);
+    rx.assign(ncomponent, 0.0), ry.assign(ncomponent, 0.0), rz.assign(ncomponent, 0.0);
+}
+
+void vmm_stats::add(const vmm_stats& s)
+{
+    count += s.count, w += s.w;
+    for(int j = 0; j < (int)sum.size(); ++j)
+    {
+        sum[j] += s.sum[j];
+        rx[j] += s.rx[j], ry[j] += s.ry[j], rz[j] += s.rz[j];
+    }
+}
+
+void vmm_stats::blend(const vmm_stats& s, double a)
+{
+    double b = s.count > 0 ? a / s.count : 0.0;
+    w = w * (1 - a) + s.w * b;
+    for(int j = 0; j < (int)sum.size(); ++j)
+    {
+        sum[j] = sum[j] * (1 - a) + s.sum[j] * b;
+        rx[j] = rx[j] * (1 - a) + s.rx[j] * b;
+        ry[j] = ry[j] * (1 - a) + s.ry[j] * b;
+        rz[j] = rz[j] * (1 - a) + s.rz[j] * b;
+    }
+}
+
+
+
+VMM::VMM(int _n, double _a)
+    : ncomponent(std::min(_n, (int)max_components)), weight(ncomponent, 1.0 / ncomponent), mx(ncomponent), my(ncomponent),
+      mz(ncomponent), kappa(ncomponent, 2.0), logc(ncomponent), index(0), alpha(_a)
+{
+    // a spherical Fibonacci set of broad lobes
+    for(int j = 0; j < ncomponent; ++j)
+    {
+        double z = 1 - (2 * j + 1.0) / ncomponent;
+        double r = sqrt(fmax(0.0, 1 - z * z));
+        double phi = j * PI * (3 - sqrt(5.0));
+        mx[j] = r * cos(phi), my[j] = r * sin(phi), mz[j] = z;
+        update_constants(j);
+    }
+    ss.reset(ncomponent);
+    step.reset(ncomponent);
+}
+
+void VMM::update_constants(int j)
+{
+    logc[j] = weight[j] > 0 ? log(weight[j] * vmf_norm(kappa[j])) - kappa[j] : -1e300;
+}
+
+void VMM::accumulate(const double* x, const double* y, const double* z, const double* w, int n, vmm_stats& out) const
+{
+    const int K = ncomponent;
+    out.tau.resize((size_t)K * block);
+    double* tau = out.tau.data();
+
+    // as WGMM::accumulate, local copies padded with samples of weight 0 to whole groups of 4
+    double bx[block], by[block], bz[block], bw[block], top[block], r[block];
+    for(int s = 0; s < n; s += block)
+    {
+        const int b = std::min(block, n - s);
+        const int groups = (b + 3) / 4;
+        double wsum = 0.0;
+        for(int k = 0; k < b; ++k)
+        {
+            bx[k] = x[s + k], by[k] = y[s + k], bz[k] = z[s + k];
+            bw[k] = w ? w[s + k] : 1.0;
+            wsum += bw[k];
+        }
+        for(int k = b; k < groups * 4; ++k)
+            bx[k] = by[k] = bz[k] = bw[k] = 0.0;
+        out.count += b;
+        out.w += wsum;
+
+        // log of weight * density, a dot product per sample and component
+        for(int j = 0; j < K; ++j)
+        {
+            double* t = tau + j * block;
+            const double c = logc[j], kx = kappa[j] * mx[j], ky = kappa[j] * my[j], kz = kappa[j] * mz[j];
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    t[k] = c + kx * bx[k] + ky * by[k] + kz * bz[k];
+                }
+        }
+
+        // log-sum-exp over the components
+        for(int g = 0; g < groups; ++g)
+            for(int l = 0; l < 4; ++l)
+                top[4 * g + l] = tau[4 * g + l], r[4 * g + l] = 0.0;
+        for(int j = 1; j < K; ++j)
+        {
+            const double* t = tau + j * block;
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    top[k] = t[k] > top[k] ? t[k] : top[k];
+                }
+        }
+        for(int j = 0; j < K; ++j)
+        {
+            double* t = tau + j * block;
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    t[k] = exp_neg(t[k] - top[k]);
+                    r[k] += t[k];
+                }
+        }
+        for(int g = 0; g < groups; ++g)
+            for(int l = 0; l < 4; ++l)
+                r[4 * g + l] = bw[4 * g + l] / r[4 * g + l];
+
+        for(int j = 0; j < K; ++j)
+        {
+            const double* t = tau + j * block;
+            double a[4] = {}, ax[4] = {}, ay[4] = {}, az[4] = {};
+            for(int g = 0; g < groups; ++g)
+                for(int l = 0; l < 4; ++l)
+                {
+                    const int k = 4 * g + l;
+                    double v = t[k] * r[k];
+                    a[l] += v;
+                    ax[l] += v * bx[k], ay[l] += v * by[k], az[l] += v * bz[k];
+                }
+
+            out.sum[j] += (a[0] + a[1]) + (a[2] + a[3]);
+            out.rx[j] += (ax[0] + ax[1]) + (ax[2] + ax[3]);
+            out.ry[j] += (ay[0] + ay[1]) + (ay[2] + ay[3]);
+            out.rz[j] += (az[0] + az[1]) + (az[2] + az[3]);
+        }
+    }
+}
+
+void VMM::Expectation(const double* x, const double* y, const double* z, const double* w, int n, double a)
+{
+    step.reset(ncomponent);
+    accumulate(x, y, z, w, n, step);
+    ss.blend(step, a);
+}
+
+bool VMM::Maximization()
+{
+    bool convergence = true;
+    for(int j = 0; j < ncomponent; ++j)
+    {
+        weight[j] = ss.w > 0 ? ss.sum[j] / ss.w : 0.0;
+        double len = sqrt(ss.rx[j] * ss.rx[j] + ss.ry[j] * ss.ry[j] + ss.rz[j] * ss.rz[j]);
+        if(ss.sum[j] <= 0 || len <= 0)
+            continue;
+
+        double ux = ss.rx[j] / len, uy = ss.ry[j] / len, uz = ss.rz[j] / len;
+        double r = fmin(len / ss.sum[j], 1 - 1e-9);
+        double k = fmin(r * (3 - r * r) / (1 - r * r), max_kappa);
+
+        double dx = ux - mx[j], dy = uy - my[j], dz = uz - mz[j], dk = k - kappa[j];
+        convergence &= dx * dx + dy * dy + dz * dz < EPS && dk * dk < EPS * k * k;
+        mx[j] = ux, my[j] = uy, mz[j] = uz, kappa[j] = k;
+    }
+
+    double total = 0.0;
+    for(int j = 0; j < ncomponent; ++j)
+        total += weight[j];
+    for(int j = 0; j < ncomponent; ++j)
+    {
+        if(total > 0)
+            weight[j] /= total;
+        update_constants(j);
+    }
+
+    return convergence;
+}
+
+void VMM::offline_trainModel(const double* x, const double* y, const double* z, const double* w, int n)
+{
+    *this = VMM(ncomponent, alpha);
+
+    // EM algorithm
+    for(int i = 0; i < max_iter; ++i)
+    {
+        // E step
+        Expectation(x, y, z, w, n, 1.0);
+
+        // M step
+        bool convergence = Maximization();
+
+        if(convergence) break;
+    }
+    index = n;
+}
+
+void VMM::online_trainModel(const direction& data, double w)
+{
+    online_trainModel(&data.x, &data.y, &data.z, &w, 1);
+}
+
+void VMM::online_trainModel(const double* x, const double* y, const double* z, const double* w, int n)
+{
+    if(n <= 0)
+        return;
+
+    // as WGMM, sample i alone would keep 1 - (index + i)^-alpha of the statistics
+    double keep = 1.0;
+    for(int i = 0; i < n; ++i)
+        keep *= index + i > 0 ? 1.0 - pow(index + i, -alpha) : 0.0;
+
+    Expectation(x, y, z, w, n, 1.0 - keep);
+
+    int before = index;
+    index += n;
+
+    if(index / update != before / update)
+        Maximization();
+}
+
+vmf_lobe VMM::component(int j) const
+{
+    return vmf_lobe { direction(mx[j], my[j], mz[j]), kappa[j], weight[j] };
+}
+
+double VMM::pdf(const direction& dir) const
+{
+    double p = 0.0;
+    for(int j = 0; j < ncomponent; ++j)
+        p += exp(logc[j] + kappa[j] * (mx[j] * dir.x + my[j] * dir.y + mz[j] * dir.z));
+    return p;
+}
+
+direction VMM::sample(double u, const vec2<double>& u2) const
+{
+    int j = 0;
+    double c = weight[0];
+    while(j + 1 < ncomponent && u >= c)
+        c += weight[++j];
+    return component(j).sample(u2);
+}
+
+void VMM::product(const direction& n, double kappa_n, vmf_lobe* out) const
+{
+    // e^(k (mu . w - 1)) e^(kn (n . w - 1)) = e^(k' (mu' . w - 1)) e^(k' - k - kn), k' mu' = k mu + kn n,
+    // and weight * vmf_norm(k) e^-k is e^logc
+    const double cn = vmf_norm(kappa_n);
+    double total = 0.0;
+    for(int j = 0; j < ncomponent; ++j)
+    {
+        direction v = direction(mx[j], my[j], mz[j]) * kappa[j] + n * kappa_n;
+        double k = v.length();
+        out[j].mu = k > 0 ? v / k : n;
+        out[j].kappa = k;
+        out[j].weight = exp(logc[j] + k - kappa_n) * cn / vmf_norm(k);
+        total += out[j].weight;
+    }
+    for(int j = 0; j < ncomponent; ++j)
+        out[j].weight = total > 0 ? out[j].weight / total : 1.0 / ncomponent;
+}
+
+void VMM::write(std::ostream& out) const
+{
+    write_raw(out, ncomponent);
+    write_raw(out, index);
+    write_raw(out, ss.w);
+    for(int j = 0; j < ncomponent; ++j)
+        for(double v : { weight[j], mx[j], my[j], mz[j], kappa[j] })
+            write_raw(out, v);
+}
+
+bool VMM::read(std::istream& in)
+{
+    int n, idx;
+    double w;
+    if(!read_raw(in, n) || !read_raw(in, idx) || !read_raw(in, w) || n <= 0 || n > max_components)
+        return false;
+
+    VMM v(n, alpha);
+    v.index = idx;
+    v.ss.w = w;
+    for(int j = 0; j < n; ++j)
+    {
+        double* p[] = { &v.weight[j], &v.mx[j], &v.my[j], &v.mz[j], &v.kappa[j] };
+        for(double* q : p)
+            if(!read_raw(in, *q) || !std::isfinite(*q))
+                return false;
+        if(v.kappa[j] < 0)
+            return false;
+        v.update_constants(j);
+
+        double s = v.weight[j] * w;
+        double r = v.kappa[j] > 1e-6 ? 1 / std::tanh(v.kappa[j]) - 1 / v.kappa[j] : v.kappa[j] / 3;
+        v.ss.sum[j] = s;
+        v.ss.rx[j] = s * r * v.mx[j], v.ss.ry[j] = s * r * v.my[j], v.ss.rz[j] = s * r * v.mz[j];
+    }
+    *this = std::move(v);
+    return true;
+}
+
+void VMM::show() const
+{
+    std::cout << "There are " << ncomponent << " components.\n" << std::endl;
+
+    for(int j = 0; j < ncomponent; ++j)
+        std::cout << "Component " << j << ": weight " << weight[j] << ", mean " << direction(mx[j], my[j], mz[j])
+                  << ", kappa " << kappa[j] << std::endl;
+}
\ No newline at end of file
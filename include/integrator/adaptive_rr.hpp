@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "math/ray.hpp"
+#include "camera/framebuffer.hpp"
+#include "parallel/tile.hpp"
+#include "kdtree/kdTree.hpp"
+
+// radiance a pre-pass path brought back through a diffuse vertex, over the throughput that reached it
+class rr_record
+{
+public:
+    point p;
+    double Lr;
+};
+
+// a diffuse vertex of a pre-pass path, what it reflected is known at the end of the path
+class rr_vertex
+{
+public:
+    point p;
+    color beta;         // throughput that reached p
+    color L;            // radiance the path had gathered before p reflected any
+};
+
+// a path split off at a vertex, waiting to be traced from its first bounce
+class rr_branch
+{
+public:
+    ray r;
+    color beta;         // after the bounce
+    int depth;          // of the vertex it leaves from, plus 1
+};
+
+/*
+    efficiency-aware russian roulette and splitting, after Vorba and Krivanek's ADRRS (2016)
+    a path at a diffuse vertex x is expected to add beta * Lr(x) to its pixel, Lr the radiance x
+    reflects; over the pixel estimate I that is its share w of the pixel, and a weight window around
+    w = 1 keeps every path near its share: below the window it survives with probability w, above it
+    splits into about w paths, each with its part of the throughput, so no path outweighs its pixel
+    and none is traced for nothing
+
+    Lr is the mean over a region of the kd-tree, I the pre-pass image box-filtered, both from a cheap
+    pre-pass that records its paths; the records are sorted before use, so the estimate is the same
+    for any thread count
+*/
+class adaptive_rr
+{
+private:
+    int width, height;
+    int samples_per_region;
+    double low, high;                   // the window, 2 / (1 + s) and 2 s / (1 + s)
+    bool recording;
+
+    std::vector<std::vector<rr_record> > records;      // per thread id, while recording
+    std::vector<double> pixel_estimate;
+    kdTree<point> regions;
+    std::vector<double> radiance;       // mean Lr per region
+
+public:
+    static const int max_vertices = 16;
+    static const int max_branches = 32;        // pending splits of one camera sample
+    static constexpr double min_survival = 0.05;
+
+    // the window spans a factor of _window around the share of the pixel
+    adaptive_rr(int _width, int _height, int _nthread, double _window = 5.0, int _samples_per_region = 128);
+
+    // around the pre-pass, whose paths record themselves
+    void begin_prepass();
+    void end_prepass(const FrameBuffer& fb);
+
+    inline bool training() const { return recording; }
+    inline bool ready() const { return !recording && !regions.empty(); }
+    inline int size() const { return regions.size(); }
+
+    void record(thread_context& ctx, const rr_vertex* v, int n, const color& L);
+
+    /*
+        how many paths go on from a vertex at p of a sample of pixel, 0 ends it, more than 1 splits it
+        beta is rescaled for each of them, u decides the roulette, at most max_split
+    */
+    int continuations(int pixel, const point& p, color& beta, double u, int max_split) const;
+};
+
+#include "adaptive_rr.inl"
\ No newline at end of file
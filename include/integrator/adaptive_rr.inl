@@ -0,0 +1,118 @@
+adaptive_rr::adaptive_rr(int _width, int _height, int _nthread, double _window, int _samples_per_region)
+    : width(_width), height(_height), samples_per_region(_samples_per_region),
+      low(2.0 / (1.0 + _window)), high(2.0 * _window / (1.0 + _window)), recording(false), records(_nthread)
+{
+}
+
+void adaptive_rr::begin_prepass()
+{
+    for(auto& r : records)
+        r.clear();
+    recording = true;
+}
+
+void adaptive_rr::end_prepass(const FrameBuffer& fb)
+{
+    recording = false;
+
+    // the pixel estimate, a 3 x 3 box so one lucky sample of the pre-pass does not set a pixel
+    pixel_estimate.assign(width * height, 0.0);
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+        {
+            double s = 0.0;
+            int n = 0;
+            for(int a = std::max(i - 1, 0); a <= std::min(i + 1, height - 1); ++a)
+                for(int b = std::max(j - 1, 0); b <= std::min(j + 1, width - 1); ++b)
+                {
+                    color c = fb.get_pixel(a, b);
+                    s += (c.x + c.y + c.z) / 3;
+                    n++;
+                }
+            pixel_estimate[i * width + j] = s / n;
+        }
+
+    // the same set in the same order whichever thread traced which tile
+    std::vector<rr_record> all;
+    for(auto& r : records)
+    {
+        all.insert(all.end(), r.begin(), r.end());
+        r.clear();
+    }
+    if(all.empty())
+        return;
+    std::sort(all.begin(), all.end(), [](const rr_record& a, const rr_record& b) {
+        if(a.p.x != b.p.x) return a.p.x < b.p.x;
+        if(a.p.y != b.p.y) return a.p.y < b.p.y;
+        if(a.p.z != b.p.z) return a.p.z < b.p.z;
+        return a.Lr < b.Lr;
+    });
+
+    // about one record in samples_per_region is a center, picked by a hash of its index, as path_guide does
+    std::vector<point> centers;
+    for(int i = 0; i < (int)all.size(); ++i)
+        if(mix_bits(i) % samples_per_region == 0)
+            centers.push_back(all[i].p);
+    if(centers.empty())
+        centers.push_back(all[0].p);
+    regions.build(std::move(centers));
+
+    radiance.assign(regions.size(), 0.0);
+    std::vector<int> count(regions.size(), 0);
+    for(const rr_record& r : all)
+    {
+        kd_neighbor nn;
+        if(!regions.knn(r.p, 1, &nn))
+            continue;
+        radiance[nn.index] += r.Lr;
+        count[nn.index]++;
+    }
+    for(int k = 0; k < regions.size(); ++k)
+        if(count[k] > 0)
+            radiance[k] /= count[k];
+}
+
+void adaptive_rr::record(thread_context& ctx, const rr_vertex* v, int n, const color& L)
+{
+    std::vector<rr_record>& out = records[ctx.id];
+    for(int i = 0; i < n; ++i)
+    {
+        // radiance reflected at the vertex, channel by channel
+        color d = L - v[i].L;
+        double Lr = 0.0;
+        for(double c : { d.x / v[i].beta.x, d.y / v[i].beta.y, d.z / v[i].beta.z })
+            if(std::isfinite(c) && c > 0)
+                Lr += c / 3;
+        out.push_back(rr_record { v[i].p, Lr });
+    }
+}
+
+int adaptive_rr::continuations(int pixel, const point& p, color& beta, double u, int max_split) const
+{
+    double I = pixel >= 0 && pixel < (int)pixel_estimate.size() ? pixel_estimate[pixel] : 0.0;
+    kd_neighbor nn;
+    if(!(I > 0) || !regions.knn(p, 1, &nn))
+        return 1;
+
+    double w = (beta.x + beta.y + beta.z) / 3 * radiance[nn.index] / I;
+    if(!std::isfinite(w))
+        return 1;
+
+    // the floor keeps every path some chance, so the image stays unbiased where the pre-pass saw no light
+    if(w < low)
+    {
+        double q = std::max(w, min_survival);
+        if(u >= q)
+            return 0;
+        beta = beta / q;
+        return 1;
+    }
+    if(w > high)
+    {
+        int n = std::min((int)std::lround(w), max_split);
+        if(n > 1)
+            beta = beta / n;
+        return std::max(n, 1);
+    }
+    return 1;
+}
\ No newline at end of file
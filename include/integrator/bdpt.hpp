@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "math/ray.hpp"
+#include "camera/framebuffer.hpp"
+#include "camera/splatbuffer.hpp"
+#include "material/material.hpp"
+#include "pdf/pdf.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+#include "mis.hpp"
+
+// a subpath vertex with the surface data its connections need, so they never query the BVH again
+class path_vertex
+{
+public:
+    hit_record rec;
+    direction wi;               // unit, toward the previous vertex
+    color throughput;           // of the subpath up to here
+    color attenuation;
+    cosine_pdf brdf_pdf;        // BRDF frame, gives the forward and reverse pdf of any direction
+    int mat_id;
+    int length;                 // edges from the camera or the light
+    double dVCM, dVC;           // partial sums of the MIS weight, see below
+};
+
+/*
+    fixed-capacity vertex storage of one thread, reused by every sample, so tracing never allocates
+    next() is a scratch slot past the stored vertices, commit() keeps it
+*/
+class alignas(64) path_buffer
+{
+private:
+    std::unique_ptr<path_vertex[]> data;
+    int count, cap;
+
+public:
+    path_buffer(int _capacity = 0) : data(new path_vertex[_capacity + 1]), count(0), cap(_capacity) {}
+
+    inline void clear() { count = 0; }
+    inline int size() const { return count; }
+    inline int capacity() const { return cap; }
+
+    inline path_vertex& next() { return data[count]; }
+    inline void commit() { if(count < cap) count++; }
+
+    inline const path_vertex& operator[](int i) const { return data[i]; }
+    inline const path_vertex* begin() const { return data.get(); }
+    inline const path_vertex* end() const { return data.get() + count; }
+};
+
+/*
+    bidirectional path tracer, every strategy of a path weighted by MIS
+        s = 0: the camera subpath hits an emitter
+        s = 1: next event estimation from a camera vertex
+        t = 1: a light vertex connected to the camera, splatted into the image
+        s, t > 1: a light vertex connected to a camera vertex
+
+    the weights are the recursive form of Georgiev's VCM (as in SmallVCM) restricted to vertex
+    connection: each subpath carries dVCM and dVC, updated in O(1) per bounce, and the weight of
+    any connection needs only the two end vertices, whatever the path length
+
+    emitters are two-sided, a pass over the image has width * height light subpaths, by default
+    one per camera sample, kept in the path_buffer of the tracing thread
+
+    with light reuse on, each pass first traces its width * height light subpaths into a shared
+    vertex pool, then every camera vertex connects to k vertices picked uniformly from the pool,
+    scaled by V / (k * N) for V pooled vertices from N subpaths: the expected value is that of
+    the one-subpath estimator, so the MIS weights stay as they are and the image stays unbiased
+    for any k, the pool amortizes the light tracing over all camera paths of the pass
+
+    light subpaths start only on emitters with an area, an environment light is neither sampled
+    nor seen, so a scene lit by one renders black
+*/
+class bdpt_integrator
+{
+private:
+    const scene& sc;
+    int max_length;             // edges of the longest path, max_depth + 1 like MC_PT
+    mis_heuristic heuristic;
+
+    // set by render
+    int width, height;
+    double n_light;             // light subpaths per pass
+    double camera_factor;       // pixel count over image plane area
+    double light_pdf_A;
+    SplatBuffer* splats;
+    std::vector<path_buffer> light_paths;       // one per pool thread
+
+    // light reuse, off when connections == 0
+    static const int light_chunk = 1024;        // subpaths per pool chunk
+    int connections;
+    std::vector<path_buffer> light_pool;        // one per chunk, vertices stored back to back
+    std::vector<int> pool_offset;               // first vertex of each chunk, the last is V
+    double pool_scale;                          // V / (connections * N)
+
+    inline double mis(double x) const { return heuristic == mis_heuristic::POWER ? x * x : x; }
+
+    // f * |cos| toward dir, pdf_dir samples dir from wi, pdf_rev wi from dir, both solid angle
+    color eval(const path_vertex& v, const direction& dir, double& pdf_dir, double& pdf_rev, double& cos_dir) const;
+    bool visible(const point& a, const point& b, thread_context& ctx) const;
+
+    // continue the subpath from v, false when it ends
+    bool scatter(const path_vertex& v, const scatter_record& srec, sampler& s, ray& r, color& throughput, double& dVCM, double& dVC) const;
+
+    // appends the vertices of one light subpath to path
+    void trace_light_path(thread_context& ctx, path_buffer& path) const;
+    void trace_light_pool(thread_pool& pool, std::vector<thread_context>& ctx, int sample_index);
+    void connect_to_camera(const path_vertex& l, thread_context& ctx) const;
+    color direct_light(const path_vertex& c, thread_context& ctx) const;
+    color connect(const path_vertex& c, const path_vertex& l, thread_context& ctx) const;
+    color connect_pool(const path_vertex& c, thread_context& ctx) const;
+
+    color Li(const ray& camera_r, thread_context& ctx);
+
+public:
+    bdpt_integrator(const scene& _sc, int _max_depth, mis_heuristic _h = mis_heuristic::POWER);
+
+    // connections per camera vertex into the pass-wide light vertex pool, 0 traces one subpath per sample
+    inline void set_light_reuse(int _connections) { connections = std::max(0, _connections); }
+
+    render_stats render(FrameBuffer& fb, thread_pool& pool, int sample_per_pixel, const sampler& proto = independent_sampler(), int tile_size = 16);
+};
+
+#include "bdpt.inl"
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include "bdpt.hpp"
+
+bdpt_integrator::bdpt_integrator(const scene& _sc, int _max_depth, mis_heuristic _h)
+    : sc(_sc), max_length(_max_depth + 1), heuristic(_h),
+      width(0), height(0), n_light(0), camera_factor(0), light_pdf_A(0), splats(nullptr),
+      connections(0), pool_scale(0) {}
+
+color bdpt_integrator::eval(const path_vertex& v, const direction& dir, double& pdf_dir, double& pdf_rev, double& cos_dir) const
+{
+    ray in(v.rec.p + v.wi, -v.wi);
+    cos_dir = fabs(dot(v.rec.normal, dir));
+    pdf_dir = v.brdf_pdf.value(dir);
+    pdf_rev = v.brdf_pdf.value(v.wi);
+    return v.attenuation * v.rec.hit_mat->brdf_cos(in, v.rec, ray(v.rec.p, dir));
+}
+
+bool bdpt_integrator::visible(const point& a, const point& b, thread_context& ctx) const
+{
+    direction d = b - a;
+    double dist = d.length();
+    hit_record rec;
+    ctx.rays++;
+    return !sc.world.hit(ray(a, d), rec, interval(0.001, dist - 0.001));
+}
+
+bool bdpt_integrator::scatter(const path_vertex& v, const scatter_record& srec, sampler& s, ray& r, color& throughput, double& dVCM, double& dVC) const
+{
+    if(srec.is_specular)
+    {
+        // forward and reverse pdf are the same delta, only the cosine is left
+        r = srec.specular_ray;
+        throughput = throughput * srec.attenuation;
+        dVCM = 0.0;
+        dVC *= mis(fabs(dot(v.rec.normal, r.get_dir())));
+        return true;
+    }
+
+    ray scattered(v.rec.p, srec.brdf_pdf.generate(s));
+    double pdf_dir, pdf_rev, cos_out;
+    color f = eval(v, scattered.get_dir(), pdf_dir, pdf_rev, cos_out);
+    if(pdf_dir <= 0 || f.maxv() <= 0)
+        return false;
+
+    throughput = throughput * f / pdf_dir;
+    dVC = mis(cos_out / pdf_dir) * (dVC * mis(pdf_rev) + dVCM);
+    dVCM = mis(1.0 / pdf_dir);
+    r = scattered;
+    return true;
+}
+
+void bdpt_integrator::trace_light_path(thread_context& ctx, path_buffer& path) const
+{
+    sampler& s = *ctx.smp;
+
+    hit_record l_rec;
+    double pdf_A;
+    if(!sc.lights->sample_surface(s, l_rec, pdf_A))
+        return;
+
+    // cosine-weighted emission from a random side
+    direction n = s.get_1d() < 0.5 ? l_rec.normal : -l_rec.normal;
+    cosine_pdf cp(n);
+    direction d = cp.generate(s);
+    double cos_light = dot(n, d);
+    if(cos_light <= 0)
+        return;
+
+    double emission_pdf = pdf_A * cos_light / PI * 0.5;
+    color throughput = l_rec.hit_mat->emitted(l_rec.uv) * cos_light / emission_pdf;
+    double dVCM = mis(pdf_A / emission_pdf);
+    double dVC = mis(cos_light / emission_pdf);
+
+    ray r(l_rec.p, d);
+    for(int length = 1; length < max_length; ++length)
+    {
+        path_vertex& v = path.next();
+        ctx.rays++;
+        if(!sc.world.hit(r, v.rec))
+            break;
+
+        double cos_in = fabs(dot(v.rec.normal, r.get_dir()));
+        dVCM *= mis(v.rec.t * v.rec.t);
+        dVCM /= mis(cos_in);
+        dVC /= mis(cos_in);
+
+        scatter_record srec;
+        if(!v.rec.hit_mat->scatter(r, v.rec, srec, s))
+            break;
+
+        v.wi = -r.get_dir();
+        v.throughput = throughput;
+        v.attenuation = srec.attenuation;
+        v.brdf_pdf = srec.brdf_pdf;
+        v.mat_id = v.rec.hit_mat->id();
+        v.length = length;
+        v.dVCM = dVCM;
+        v.dVC = dVC;
+
+        if(!srec.is_specular)
+            connect_to_camera(v, ctx);
+
+        bool more = length + 1 < max_length && scatter(v, srec, s, r, throughput, dVCM, dVC);
+
+        // a camera vertex adds at least two edges
+        if(!srec.is_specular && length + 2 <= max_length)
+            path.commit();
+        if(!more)
+            break;
+    }
+}
+
+void bdpt_integrator::connect_to_camera(const path_vertex& l, thread_context& ctx) const
+{
+    double w_img, h_img;
+    if(!sc.camera.project(l.rec.p, w_img, h_img))
+        return;
+
+    direction d = sc.camera.get_origin() - l.rec.p;
+    double dist2 = d.length_square();
+    d = d / sqrt(dist2);
+
+    double pdf_dir, pdf_rev, cos_to_camera;
+    color f = eval(l, d, pdf_dir, pdf_rev, cos_to_camera);
+    if(f.maxv() <= 0)
+        return;
+
+    // pdf of the camera sampling this vertex, per pixel
+    double cos_camera = -dot(sc.camera.get_forward(), d);
+    double camera_pdf_W = camera_factor / (cos_camera * cos_camera * cos_camera);
+    double camera_pdf_A = camera_pdf_W * cos_to_camera / dist2;
+
+    double w_light = mis(camera_pdf_A / n_light) * (l.dVCM + l.dVC * mis(pdf_rev));
+    double weight = 1.0 / (w_light + 1.0);
+
+    if(!visible(l.rec.p, sc.camera.get_origin(), ctx))
+        return;
+
+    int row = std::min((int)(h_img * height), height - 1);
+    int col = std::min((int)(w_img * width), width - 1);
+    splats->add(row, col, l.throughput * f * (weight * camera_pdf_W / (dist2 * n_light)));
+}
+
+color bdpt_integrator::direct_light(const path_vertex& c, thread_context& ctx) const
+{
+    hit_record l_rec;
+    double pdf_A;
+    if(!sc.lights->sample_surface(*ctx.smp, l_rec, pdf_A))
+        return color(0.0);
+
+    direction d = l_rec.p - c.rec.p;
+    double dist2 = d.length_square();
+    d = d / sqrt(dist2);
+
+    double cos_light = fabs(dot(l_rec.normal, d));
+    if(cos_light < EPS)
+        return color(0.0);
+
+    double pdf_dir, pdf_rev, cos_to_light;
+    color f = eval(c, d, pdf_dir, pdf_rev, cos_to_light);
+    if(f.maxv() <= 0)
+        return color(0.0);
+
+    double direct_pdf_W = pdf_A * dist2 / cos_light;
+    double emission_pdf = pdf_A * cos_light / PI * 0.5;
+
+    double w_light = mis(pdf_dir / direct_pdf_W);
+    double w_camera = mis(emission_pdf * cos_to_light / (direct_pdf_W * cos_light)) * (c.dVCM + c.dVC * mis(pdf_rev));
+    double weight = 1.0 / (w_light + 1.0 + w_camera);
+
+    if(!visible(c.rec.p, l_rec.p, ctx))
+        return color(0.0);
+
+    return l_rec.hit_mat->emitted(l_rec.uv) * f * (weight / direct_pdf_W);
+}
+
+color bdpt_integrator::connect(const path_vertex& c, const path_vertex& l, thread_context& ctx) const
+{
+    direction d = l.rec.p - c.rec.p;
+    double dist2 = d.length_square();
+    d = d / sqrt(dist2);
+
+    double c_pdf_dir, c_pdf_rev, c_cos;
+    color fc = eval(c, d, c_pdf_dir, c_pdf_rev, c_cos);
+    if(fc.maxv() <= 0)
+        return color(0.0);
+
+    double l_pdf_dir, l_pdf_rev, l_cos;
+    color fl = eval(l, -d, l_pdf_dir, l_pdf_rev, l_cos);
+    if(fl.maxv() <= 0)
+        return color(0.0);
+
+    // pdf of each side sampling the other's vertex, area measure
+    double c_pdf_A = c_pdf_dir * l_cos / dist2;
+    double l_pdf_A = l_pdf_dir * c_cos / dist2;
+
+    double w_light = mis(c_pdf_A) * (l.dVCM + l.dVC * mis(l_pdf_rev));
+    double w_camera = mis(l_pdf_A) * (c.dVCM + c.dVC * mis(c_pdf_rev));
+    double weight = 1.0 / (w_light + 1.0 + w_camera);
+
+    if(!visible(c.rec.p, l.rec.p, ctx))
+        return color(0.0);
+
+    return fc * fl * (weight / dist2);
+}
+
+// the light subpaths of one pass, chunk c always holds the same subpaths whatever thread traced it
+void bdpt_integrator::trace_light_pool(thread_pool& pool, std::vector<thread_context>& ctx, int sample_index)
+{
+    const int n = width * height;
+    const int nchunk = (n + light_chunk - 1) / light_chunk;
+    if((int)light_pool.size() != nchunk)
+    {
+        light_pool.clear();
+        for(int c = 0; c < nchunk; ++c)
+            light_pool.emplace_back(light_chunk * std::max(0, max_length - 2));
+        pool_offset.assign(nchunk + 1, 0);
+    }
+
+    pool.parallel_for(nchunk, [&](int c, int id) {
+        path_buffer& chunk = light_pool[c];
+        chunk.clear();
+        int end = std::min(n, (c + 1) * light_chunk);
+        for(int p = c * light_chunk; p < end; ++p)
+        {
+            ctx[id].smp->start_pixel_sample(p / width, p % width, sample_index);
+            trace_light_path(ctx[id], chunk);
+        }
+    });
+
+    for(int c = 0; c < nchunk; ++c)
+        pool_offset[c + 1] = pool_offset[c] + light_pool[c].size();
+    pool_scale = pool_offset[nchunk] / (connections * n_light);
+}
+
+color bdpt_integrator::connect_pool(const path_vertex& c, thread_context& ctx) const
+{
+    const int total = pool_offset.back();
+    if(total == 0)
+        return color(0.0);
+
+    color L(0.0);
+    for(int k = 0; k < connections; ++k)
+    {
+        int g = std::min((int)(ctx.smp->get_1d() * total), total - 1);
+        int chunk = std::upper_bound(pool_offset.begin(), pool_offset.end(), g) - pool_offset.begin() - 1;
+        const path_vertex& l = light_pool[chunk][g - pool_offset[chunk]];
+        if(l.length + 1 + c.length > max_length)
+            continue;
+        L = L + l.throughput * connect(c, l, ctx);
+    }
+    return L * pool_scale;
+}
+
+color bdpt_integrator::Li(const ray& camera_r, thread_context& ctx)
+{
+    sampler& s = *ctx.smp;
+
+    path_buffer& light_path = light_paths[ctx.id];
+    light_path.clear();
+    if(connections == 0)
+        trace_light_path(ctx, light_path);
+
+    double cos_camera = dot(sc.camera.get_forward(), camera_r.get_dir());
+    double camera_pdf_W = camera_factor / (cos_camera * cos_camera * cos_camera);
+
+    color L(0.0), throughput(1.0);
+    double dVCM = mis(n_light / camera_pdf_W);
+    double dVC = 0.0;
+
+    ray r = camera_r;
+    for(int length = 1; ; ++length)
+    {
+        path_vertex v;
+        ctx.rays++;
+        if(!sc.world.hit(r, v.rec))
+            break;
+
+        double cos_in = fabs(dot(v.rec.normal, r.get_dir()));
+        dVCM *= mis(v.rec.t * v.rec.t);
+        dVCM /= mis(cos_in);
+        dVC /= mis(cos_in);
+
+        color Le = v.rec.hit_mat->emitted(v.rec.uv);
+        if(Le.maxv() > 0)
+        {
+            if(length == 1)
+                L = L + Le;
+            else
+            {
+                double emission_pdf = light_pdf_A * cos_in / PI * 0.5;
+                double w_camera = mis(light_pdf_A) * dVCM + mis(emission_pdf) * dVC;
+                L = L + throughput * Le / (1.0 + w_camera);
+            }
+            break;
+        }
+
+        if(length >= max_length)
+            break;
+
+        scatter_record srec;
+        if(!v.rec.hit_mat->scatter(r, v.rec, srec, s))
+            break;
+
+        v.wi = -r.get_dir();
+        v.throughput = throughput;
+        v.attenuation = srec.attenuation;
+        v.brdf_pdf = srec.brdf_pdf;
+        v.mat_id = v.rec.hit_mat->id();
+        v.length = length;
+        v.dVCM = dVCM;
+        v.dVC = dVC;
+
+        if(!srec.is_specular)
+        {
+            L = L + throughput * direct_light(v, ctx);
+            if(connections > 0)
+                L = L + throughput * connect_pool(v, ctx);
+
+            for(const path_vertex& l : light_path)
+            {
+                if(l.length + 1 + length > max_length)
+                    break;
+                L = L + throughput * l.throughput * connect(v, l, ctx);
+            }
+        }
+
+        if(!scatter(v, srec, s, r, throughput, dVCM, dVC))
+            break;
+    }
+
+    return L;
+}
+
+render_stats bdpt_integrator::render(FrameBuffer& fb, thread_pool& pool, int sample_per_pixel, const sampler& proto, int tile_size)
+{
+    width = fb.get_width(), height = fb.get_height();
+    n_light = (double)width * height;
+    camera_factor = n_light / sc.camera.plane_area();
+    light_pdf_A = 1.0 / sc.lights->area();
+
+    SplatBuffer splat(width, height);
+    splats = &splat;
+
+    // light vertices have lengths 1 .. max_length - 2
+    light_paths.clear();
+    for(int i = 0; i < pool.size(); ++i)
+        light_paths.emplace_back(max_length);
+
+    auto pixel_samples = [&](int i, int j, thread_context& ctx, int k0, int k1) {
+        color result(0, 0, 0);
+        for(int k = k0; k < k1; ++k)
+        {
+            ctx.smp->start_pixel_sample(i, j, k);
+
+            coord jitter = ctx.smp->get_2d();
+            double u = (i + jitter.x) / height;
+            double v = (j + jitter.y) / width;
+
+            result = result + Li(sc.camera.get_ray(v, u), ctx);
+        }
+        ctx.samples += k1 - k0;
+        return result;
+    };
+
+    render_stats stats;
+    if(connections == 0)
+    {
+        stats = render_tiles(fb, pool, tile_size, [&](int i, int j, thread_context& ctx) {
+            return pixel_samples(i, j, ctx, 0, sample_per_pixel) / sample_per_pixel;
+        }, proto);
+    }
+    else
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<thread_context> ctx(pool.size());
+        for(int i = 0; i < pool.size(); ++i)
+        {
+            ctx[i].id = i;
+            ctx[i].smp = proto.clone();
+        }
+
+        // one pass per sample, light subpaths take the sample indices after the camera's
+        FrameBuffer pass(width, height);
+        std::vector<color> accum(width * height, color(0.0));
+        for(int k = 0; k < sample_per_pixel; ++k)
+        {
+            trace_light_pool(pool, ctx, sample_per_pixel + k);
+
+            render_stats s = render_tiles(pass, pool, tile_size, [&](int i, int j, thread_context& c) {
+                return pixel_samples(i, j, c, k, k + 1);
+            }, proto);
+            stats.rays += s.rays;
+            stats.samples += s.samples;
+
+            for(int i = 0; i < height; ++i)
+                for(int j = 0; j < width; ++j)
+                    accum[i * width + j] = accum[i * width + j] + pass.get_pixel(i, j);
+        }
+
+        for(int i = 0; i < height; ++i)
+            for(int j = 0; j < width; ++j)
+                fb.set_pixel(i, j, accum[i * width + j] / sample_per_pixel);
+
+        for(const auto& c : ctx)
+            stats.rays += c.rays;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // light tracing, every pass adds width * height light subpaths to the splats
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+            fb.set_pixel(i, j, fb.get_pixel(i, j) + splat.get(i, j) / sample_per_pixel);
+
+    splats = nullptr;
+    return stats;
+}
\ No newline at end of file
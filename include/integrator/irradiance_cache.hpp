@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "math/ray.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+#include "kdtree/kd_forest.hpp"
+
+// indirect irradiance at a point of a Lambertian surface, with its gradients and validity radius
+class cache_record
+{
+public:
+    point p;
+    direction n;
+    color E;
+    double R;                   // clamped harmonic mean distance of the gather rays
+    color grad_t[3];            // dE/dx, dE/dy, dE/dz
+    color grad_r[3];            // rotational gradient, dotted with n_record x n
+};
+
+inline const point& kd_position(const cache_record& r) { return r.p; }
+
+/*
+    irradiance cache (Ward 1988) with the gradients of Ward and Heckbert 1992
+    a record gathers theta x phi stratified cosine-weighted rays over the hemisphere; the radiance
+    along each comes from the caller, so the cache holds whatever the integrator calls indirect
+    light, and the strata give the translational and rotational gradients of E for free
+
+    a lookup blends every record with error eps = |p - p_i| / R_i + sqrt(1 - n . n_i) < accuracy,
+    weighted by 1 / eps - 1 / accuracy, each extrapolated with its gradients; records in front of
+    p are skipped, and a point no record covers gets a new one, so the cache fills lazily where
+    the camera looks
+
+    records live in a kd_forest, every thread reads its own snapshot without a lock; a thread
+    keeps the records it gathers in its own pending list, which its lookups also search, and
+    inserts them batch records at a time, so the forest's writer lock and the snapshot reloads
+    are paid once per batch; flush() inserts what every thread still holds, between passes
+    the image depends on which thread got to a region first and is not deterministic across
+    thread counts
+*/
+class irradiance_cache
+{
+private:
+    const scene& sc;
+    double r_min, r_max;
+    double accuracy;
+    int theta_strata, phi_strata;
+
+    // what a thread owns, padded so threads never share a cache line
+    class alignas(64) local
+    {
+    public:
+        const kd_snapshot<cache_record>* view;      // in the forest's slot of the thread id
+        std::vector<cache_record> pending;          // gathered, not inserted yet
+        long long hits, misses;
+
+        // gather scratch, one entry per stratum
+        std::vector<color> L;
+        std::vector<double> dist, tan_theta;
+
+        local() : view(nullptr), hits(0), misses(0) {}
+    };
+
+    int batch;
+    kd_forest<cache_record> records;
+    std::vector<local> threads;     // per thread id
+
+    bool interpolate(const local& t, const point& p, const direction& n, color& E) const;
+
+    template <class F>
+    cache_record gather(const hit_record& rec, thread_context& ctx, local& t, F& incoming) const;
+
+public:
+    irradiance_cache(const scene& _sc, int _nthread, double _r_min, double _r_max, double _accuracy = 0.25, int _theta = 8, int _phi = 32,
+                     int _batch = 64);
+
+    /*
+        indirect irradiance arriving at rec, interpolated from the records or gathered into a new one
+        incoming(ray, thread_context&, double& t) is the radiance arriving at the ray's origin from its
+        direction, and sets t to the distance of the ray's first hit (INF on a miss) when it traces
+        the ray, so the gather does not trace it again
+    */
+    template <class F>
+    color irradiance(const hit_record& rec, thread_context& ctx, F&& incoming);
+
+    // every thread's pending records into the forest, while no thread renders
+    void flush();
+
+    // while no thread renders
+    int size() const;
+    long long lookups() const;
+    long long gathers() const;
+};
+
+#include "irradiance_cache.inl"
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "irradiance_cache.hpp"
+
+irradiance_cache::irradiance_cache(const scene& _sc, int _nthread, double _r_min, double _r_max, double _accuracy, int _theta, int _phi,
+                                   int _batch)
+    : sc(_sc), r_min(_r_min), r_max(_r_max), accuracy(_accuracy), theta_strata(_theta), phi_strata(_phi),
+      batch(std::max(1, _batch)), records(_nthread, 64), threads(_nthread)
+{
+    for(local& t : threads)
+    {
+        t.pending.reserve(batch);
+        t.L.resize(_theta * _phi);
+        t.dist.resize(_theta * _phi);
+        t.tan_theta.resize(_theta * _phi);
+    }
+}
+
+void irradiance_cache::flush()
+{
+    for(local& t : threads)
+    {
+        records.insert(std::move(t.pending));
+        t.pending.clear();
+    }
+}
+
+int irradiance_cache::size() const
+{
+    int n = records.size();
+    for(const local& t : threads)
+        n += t.pending.size();
+    return n;
+}
+
+long long irradiance_cache::lookups() const
+{
+    long long n = 0;
+    for(const local& t : threads)
+        n += t.hits + t.misses;
+    return n;
+}
+
+long long irradiance_cache::gathers() const
+{
+    long long n = 0;
+    for(const local& t : threads)
+        n += t.misses;
+    return n;
+}
+
+bool irradiance_cache::interpolate(const local& t, const point& p, const direction& n, color& E) const
+{
+    color sum(0.0);
+    double wsum = 0.0;
+
+    auto blend = [&](const cache_record& r, double d2) {
+        double c = dot(n, r.n);
+        if(c <= 0)
+            return;
+        double eps = sqrt(d2) / r.R + sqrt(fmax(0.0, 1.0 - c));
+        if(eps >= accuracy)
+            return;
+
+        // a record in front of p sees light p may not
+        direction dp = p - r.p;
+        if(dot(dp, (n + r.n) * 0.5) < -0.01 * r.R)
+            return;
+
+        direction nr = cross(r.n, n);
+        color Ei = r.E + r.grad_r[0] * nr.x + r.grad_r[1] * nr.y + r.grad_r[2] * nr.z
+                       + r.grad_t[0] * dp.x + r.grad_t[1] * dp.y + r.grad_t[2] * dp.z;
+        Ei = color(fmax(Ei.x, 0.0), fmax(Ei.y, 0.0), fmax(Ei.z, 0.0));
+
+        double w = 1.0 / fmax(eps, 1e-6) - 1.0 / accuracy;
+        sum = sum + Ei * w;
+        wsum += w;
+    };
+
+    const double r2 = accuracy * r_max * accuracy * r_max;
+    t.view->range(p, accuracy * r_max, blend);
+    for(const cache_record& r : t.pending)
+    {
+        double d2 = (p - r.p).length_square();
+        if(d2 <= r2)
+            blend(r, d2);
+    }
+
+    if(wsum <= 0)
+        return false;
+    E = sum / wsum;
+    return true;
+}
+
+template <class F>
+cache_record irradiance_cache::gather(const hit_record& rec, thread_context& ctx, local& own, F& incoming) const
+{
+    const int M = theta_strata, N = phi_strata;
+    const point& p = rec.p;
+    const direction n = rec.normal;
+    direction t = cross(fabs(n.x) > 0.9 ? direction(0, 1, 0) : direction(1, 0, 0), n).normalize();
+    direction b = cross(n, t);
+
+    // stratum (j, k): sin^2 theta in [j, j + 1) / M, phi in [k, k + 1) * 2 pi / N
+    std::vector<color>& L = own.L;
+    std::vector<double>& dist = own.dist;
+    std::vector<double>& tan_theta = own.tan_theta;
+
+    color sum(0.0);
+    double inv_dist = 0.0;
+    for(int j = 0; j < M; ++j)
+        for(int k = 0; k < N; ++k)
+        {
+            coord u = ctx.smp->get_2d();
+            double sin2 = (j + u.x) / M;
+            double sin_t = sqrt(sin2), cos_t = sqrt(fmax(0.0, 1.0 - sin2));
+            double phi = 2 * PI * (k + u.y) / N;
+            ray g(p, t * (sin_t * cos(phi)) + b * (sin_t * sin(phi)) + n * cos_t);
+
+            int i = j * N + k;
+            double d = -1.0;
+            L[i] = incoming(g, ctx, d);
+            if(d < 0)
+            {
+                hit_record h;
+                ctx.rays++;
+                d = sc.world.hit(g, h) ? h.t : INF;
+            }
+
+            dist[i] = fmax(d, r_min);
+            tan_theta[i] = sin_t / fmax(cos_t, 1e-3);
+            sum = sum + L[i];
+            inv_dist += 1.0 / d;
+        }
+
+    cache_record r;
+    r.p = p;
+    r.n = n;
+    r.E = sum * (PI / (M * N));
+    r.R = myclamp(inv_dist > 0 ? M * N / inv_dist : INF, r_min, r_max);
+
+    color gt[3] = { color(0.0), color(0.0), color(0.0) };
+    color gr[3] = { color(0.0), color(0.0), color(0.0) };
+    auto add = [](color* g, const direction& v, const color& c) {
+        g[0] = g[0] + c * v.x;
+        g[1] = g[1] + c * v.y;
+        g[2] = g[2] + c * v.z;
+    };
+
+    for(int k = 0; k < N; ++k)
+    {
+        double phi_c = 2 * PI * (k + 0.5) / N;      // stratum center
+        double phi_e = 2 * PI * k / N;              // edge to stratum k - 1
+        direction u_k = t * cos(phi_c) + b * sin(phi_c);
+        direction v_k = t * -sin(phi_c) + b * cos(phi_c);
+        direction v_e = t * -sin(phi_e) + b * cos(phi_e);
+        int km = (k + N - 1) % N;
+
+        // rotation: the cosine weights of every sample tilt with the normal
+        color rot(0.0);
+        for(int j = 0; j < M; ++j)
+            rot = rot - L[j * N + k] * tan_theta[j * N + k];
+        add(gr, v_k, rot * (PI / (M * N)));
+
+        // translation: the boundaries between strata move with p, faster toward near geometry
+        color across_theta(0.0), across_phi(0.0);
+        for(int j = 1; j < M; ++j)
+        {
+            double sin_e = sqrt((double)j / M), cos2_e = 1.0 - (double)j / M;
+            double d = fmin(dist[j * N + k], dist[(j - 1) * N + k]);
+            across_theta = across_theta + (L[j * N + k] - L[(j - 1) * N + k]) * (sin_e * cos2_e / d);
+        }
+        for(int j = 0; j < M; ++j)
+        {
+            double d = fmin(dist[j * N + k], dist[j * N + km]);
+            across_phi = across_phi + (L[j * N + k] - L[j * N + km]) * ((sqrt((j + 1.0) / M) - sqrt((double)j / M)) / d);
+        }
+        add(gt, u_k, across_theta * (2 * PI / N));
+        add(gt, v_e, across_phi);
+    }
+
+    for(int a = 0; a < 3; ++a)
+        r.grad_t[a] = gt[a], r.grad_r[a] = gr[a];
+    return r;
+}
+
+template <class F>
+color irradiance_cache::irradiance(const hit_record& rec, thread_context& ctx, F&& incoming)
+{
+    local& own = threads[ctx.id];
+    records.refresh(ctx.id, own.view);
+
+    color E;
+    if(interpolate(own, rec.p, rec.normal, E))
+    {
+        own.hits++;
+        return E;
+    }
+
+    own.misses++;
+    cache_record r = gather(rec, ctx, own, incoming);
+    own.pending.push_back(r);
+    if((int)own.pending.size() >= batch)
+    {
+        records.insert(std::move(own.pending));
+        own.pending.clear();
+        own.pending.reserve(batch);
+    }
+    return r.E;
+}
\ No newline at end of file
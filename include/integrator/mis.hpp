@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cmath>
+
+enum class mis_heuristic { BALANCE, POWER };
+
+/*
+    weight of a sample drawn with pdf p_f against one other strategy with pdf p_g
+    (Veach), both with one sample; power uses beta = 2
+*/
+inline double mis_weight(double p_f, double p_g, mis_heuristic h)
+{
+    if(h == mis_heuristic::POWER)
+        p_f *= p_f, p_g *= p_g;
+    double sum = p_f + p_g;
+    return sum > 0 ? p_f / sum : 0.0;
+}
\ No newline at end of file
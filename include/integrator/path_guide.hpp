@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "math/ray.hpp"
+#include "pdf/pdf.hpp"
+#include "gmm/gmm.hpp"
+#include "gmm/vmm.hpp"
+#include "parallel/tile.hpp"
+#include "parallel/spsc_ring.hpp"
+#include "kdtree/kdTree.hpp"
+
+// the mixtures a guide fits: WGMMs in the squares of 6 hemispheres, or one VMM over the sphere
+enum class GUIDE_DIST { GUIDE_GMM, GUIDE_VMM };
+
+// a direction leaving a diffuse vertex, weighted by the light it brought back, square is for GUIDE_GMM only
+class guide_sample
+{
+public:
+    point p;
+    int hemisphere;
+    direction dir;
+    coord square;
+    double w;
+};
+
+inline const point& kd_position(const guide_sample& s) { return s.p; }
+
+// a bounce of a path as the integrator recorded it, the light it brought back is known at the end of the path
+class guide_vertex
+{
+public:
+    point p;
+    int hemisphere;         // nearest to the normal
+    direction dir;          // sampled, unit
+    double cosine;          // of dir to the normal
+    double pdf;             // of dir
+    color beta;             // throughput after the bounce
+    color L;                // radiance the path had gathered before the bounce
+};
+
+// the regions and mixtures of a guide after some passes of training, immutable once published
+class guide_model
+{
+public:
+    kdTree<point> regions;
+    std::vector<WGMM> models;       // GUIDE_GMM, 6 per region
+    std::vector<VMM> spheres;       // GUIDE_VMM, 1 per region
+    std::vector<char> fitted;       // per mixture
+
+    int region(const point& p) const;
+};
+
+// the guide's density at a vertex, of whichever mixture it fits, invalid where it has no fit yet
+class guide_pdf : public pdf
+{
+public:
+    gmm_pdf gaussian;
+    vmm_pdf spherical;
+
+    inline bool valid() const { return gaussian.valid() || spherical.valid(); }
+
+    virtual double value(const direction& dir) const override
+    {
+        return gaussian.valid() ? gaussian.value(dir) : spherical.value(dir);
+    }
+    virtual direction generate(sampler& s) const override
+    {
+        return gaussian.valid() ? gaussian.generate(s) : spherical.generate(s);
+    }
+};
+
+/*
+    path guiding with weighted Gaussian mixtures (Vorba et al. 2014)
+    the scene is cut into the Voronoi cells of region centers picked among the vertices of the first
+    training pass, so regions are small where paths meet surfaces often; every region has a WGMM
+    for each of the 6 axis hemispheres, a vertex uses the one its normal is nearest to; or, with
+    GUIDE_VMM, one vMF mixture over the whole sphere, which every normal of the region shares, so a
+    lookup multiplies it by the cosine lobe of the vertex's own normal
+
+    a training pass records every diffuse bounce, the radiance the rest of the path brought back
+    through it divides out of the path's contribution after it, and weights the direction by
+    luminance * cos / pdf, so the mixture follows the incident light times the cosine; the VMM fits
+    the same weights, luminance / pdf alone lets grazing samples with a tiny pdf dominate its fit
+    at the end of a pass the samples are sorted and grouped by model, a model with no fit yet gets
+    offline EM once it has enough samples, a fitted one gets stepwise online EM, batches of samples in order
+    sorted samples keep the models, hence the image, independent of the thread count
+
+    training never runs on the render threads: they push samples into a lock-free ring each, a
+    background thread drains the rings while the pass renders, and the fit of a pass runs on a pool
+    of trainer threads while the next pass renders; end_training publishes the previous fit with one
+    atomic pointer store, so a pass renders with the fit of the passes up to two before it, and the
+    same one whatever the timing; a full ring drops samples, which only dropped() and an image that
+    depends on the timing show, make the rings deeper then
+
+    the integrator samples the mixture with probability guided_fraction and the BRDF otherwise,
+    and divides by the one-sample MIS mix of both densities
+*/
+class path_guide
+{
+private:
+    GUIDE_DIST dist;
+    int ncomponent;
+    int samples_per_region;
+    static const int online_batch = 32;                 // samples per stepwise EM update
+    static const int large_fit = 4 * WGMM::chunk;       // samples of a first fit that gets the whole trainer pool
+    double guided_fraction;
+
+    bool recording;
+    std::vector<std::unique_ptr<spsc_ring<guide_sample> > > rings;     // per thread id
+    std::vector<std::vector<guide_sample> > drained;                    // per thread id, under m
+
+    std::thread drainer;
+    std::mutex m;
+    std::condition_variable cv;
+    bool flush, stop;
+
+    thread_pool trainers;
+    std::thread fit_thread;
+    std::shared_ptr<guide_model> next;                  // of the fit in flight
+    std::shared_ptr<const guide_model> owner;           // of the published one
+    std::atomic<const guide_model*> current;
+
+    void drain_loop();
+    void build_regions(guide_model& g, const std::vector<guide_sample>& samples) const;
+    void fit(guide_model& g, std::vector<guide_sample> samples);
+    void publish();
+
+public:
+    static const int max_vertices = 16;
+
+    path_guide(int _nthread, GUIDE_DIST _dist = GUIDE_DIST::GUIDE_GMM, int _components = 6, int _samples_per_region = 16,
+               double _guided_fraction = 0.5, int _ntrainer = 2, int _queue_capacity = 1 << 16);
+    ~path_guide();
+
+    path_guide(const path_guide&) = delete;
+    path_guide& operator=(const path_guide&) = delete;
+
+    // passes between begin_training and end_training record their samples, both run between passes
+    void begin_training();
+    void end_training();
+
+    // waits for the fit of the last pass and publishes it
+    void finish_training();
+
+    /*
+        the published model as a binary file: the scene hash, the region centers with their kd-tree
+        split axes, then every mixture; load takes a file only when the hash, the kind of mixture and
+        the number of components match, and publishes it at once, so the first pass is guided and
+        training goes on from it; both run between passes
+    */
+    bool save(const std::string& file, uint64_t scene_hash) const;
+    bool load(const std::string& file, uint64_t scene_hash);
+
+    inline bool training() const { return recording; }
+    inline double fraction() const { return guided_fraction; }
+    inline int per_region() const { return dist == GUIDE_DIST::GUIDE_GMM ? 6 : 1; }
+    int size() const;
+
+    // samples waiting in the rings, the most one ring held, and the samples full rings dropped
+    size_t queue_depth() const;
+    size_t max_queue_depth() const;
+    long long dropped() const;
+
+    // the mixture of the region and hemisphere of a vertex, invalid when it has no fit yet
+    guide_pdf lookup(const point& p, const direction& n) const;
+
+    // the bounces of one path that ended with radiance L
+    void record(thread_context& ctx, const guide_vertex* v, int n, const color& L);
+};
+
+#include "path_guide.inl"
\ No newline at end of file
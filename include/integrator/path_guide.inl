@@ -0,0 +1,352 @@
+#include "path_guide.hpp"
+
+int guide_model::region(const point& p) const
+{
+    kd_neighbor nn;
+    return regions.knn(p, 1, &nn) ? nn.index : -1;
+}
+
+path_guide::path_guide(int _nthread, GUIDE_DIST _dist, int _components, int _samples_per_region, double _guided_fraction,
+                       int _ntrainer, int _queue_capacity)
+    : dist(_dist), ncomponent(_components), samples_per_region(_samples_per_region), guided_fraction(_guided_fraction),
+      recording(false), drained(_nthread), flush(false), stop(false), trainers(_ntrainer), current(nullptr)
+{
+    for(int i = 0; i < _nthread; ++i)
+        rings.emplace_back(new spsc_ring<guide_sample>(_queue_capacity));
+    drainer = std::thread(&path_guide::drain_loop, this);
+}
+
+path_guide::~path_guide()
+{
+    if(fit_thread.joinable())
+        fit_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+    }
+    cv.notify_all();
+    drainer.join();
+}
+
+void path_guide::drain_loop()
+{
+    std::unique_lock<std::mutex> lock(m);
+    while(true)
+    {
+        // wakes often enough that a ring fills only when a thread records much faster than this copies
+        cv.wait_for(lock, std::chrono::milliseconds(1), [&] { return stop || flush; });
+        for(size_t i = 0; i < rings.size(); ++i)
+            rings[i]->drain([&](const guide_sample& s) { drained[i].push_back(s); });
+
+        if(flush)
+        {
+            flush = false;
+            cv.notify_all();
+        }
+        if(stop)
+            return;
+    }
+}
+
+void path_guide::build_regions(guide_model& g, const std::vector<guide_sample>& samples) const
+{
+    // about one sample in samples_per_region, picked by a hash of its index, so the centers follow the density of the vertices
+    const int n = samples.size();
+    std::vector<point> centers;
+    for(int i = 0; i < n; ++i)
+        if(mix_bits(i) % samples_per_region == 0)
+            centers.push_back(samples[i].p);
+    if(centers.empty())
+        centers.push_back(samples[0].p);
+
+    g.regions.build(std::move(centers));
+    if(dist == GUIDE_DIST::GUIDE_GMM)
+        g.models.assign(g.regions.size() * 6, WGMM(ncomponent));
+    else
+        g.spheres.assign(g.regions.size(), VMM(ncomponent));
+    g.fitted.assign(g.regions.size() * per_region(), 0);
+}
+
+void path_guide::begin_training()
+{
+    recording = true;
+}
+
+void path_guide::end_training()
+{
+    recording = false;
+
+    // the render threads are done, so one more drain takes every sample of the pass
+    std::vector<guide_sample> samples;
+    {
+        std::unique_lock<std::mutex> lock(m);
+        flush = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return !flush; });
+        for(auto& d : drained)
+        {
+            samples.insert(samples.end(), d.begin(), d.end());
+            d.clear();
+        }
+    }
+
+    // publish the fit of the pass before, and fit this one on top of it in the background
+    publish();
+    if(samples.empty())
+        return;
+    next = owner ? std::make_shared<guide_model>(*owner) : std::make_shared<guide_model>();
+    fit_thread = std::thread(&path_guide::fit, this, std::ref(*next), std::move(samples));
+}
+
+void path_guide::finish_training()
+{
+    recording = false;
+    publish();
+}
+
+void path_guide::publish()
+{
+    if(!fit_thread.joinable())
+        return;
+    fit_thread.join();
+
+    // nothing renders between passes, so the old model goes with no reader left on it
+    owner = std::move(next);
+    current.store(owner.get(), std::memory_order_release);
+}
+
+static const char guide_magic[8] = { 'P', 'G', 'U', 'I', 'D', 'E', '1', 0 };
+
+bool path_guide::save(const std::string& file, uint64_t scene_hash) const
+{
+    const guide_model* g = current.load(std::memory_order_acquire);
+    std::ofstream out(file, std::ios::binary);
+    if(!g || !out)
+        return false;
+
+    out.write(guide_magic, sizeof(guide_magic));
+    write_raw(out, scene_hash);
+    write_raw(out, (int)dist);
+    write_raw(out, ncomponent);
+    write_raw(out, g->regions.size());
+    for(int i = 0; i < g->regions.size(); ++i)
+    {
+        write_raw(out, g->regions[i]);
+        write_raw(out, (uint8_t)g->regions.axis(i));
+    }
+
+    for(int m = 0; m < (int)g->fitted.size(); ++m)
+    {
+        write_raw(out, g->fitted[m]);
+        if(!g->fitted[m])
+            continue;
+        if(dist == GUIDE_DIST::GUIDE_GMM)
+            g->models[m].write(out);
+        else
+            g->spheres[m].write(out);
+    }
+    return (bool)out;
+}
+
+bool path_guide::load(const std::string& file, uint64_t scene_hash)
+{
+    std::ifstream in(file, std::ios::binary);
+    char magic[8];
+    uint64_t h;
+    int d, k, n;
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, guide_magic, sizeof(magic)) != 0)
+        return false;
+    if(!read_raw(in, h) || !read_raw(in, d) || !read_raw(in, k) || !read_raw(in, n))
+        return false;
+    if(h != scene_hash || d != (int)dist || k != ncomponent || n <= 0)
+        return false;
+
+    std::vector<point> centers(n);
+    std::vector<uint8_t> axes(n);
+    for(int i = 0; i < n; ++i)
+        if(!read_raw(in, centers[i]) || !read_raw(in, axes[i]))
+            return false;
+
+    auto g = std::make_shared<guide_model>();
+    if(!g->regions.assign(std::move(centers), std::move(axes)))
+        return false;
+    g->fitted.assign(n * per_region(), 0);
+    if(dist == GUIDE_DIST::GUIDE_GMM)
+        g->models.assign(g->fitted.size(), WGMM(ncomponent));
+    else
+        g->spheres.assign(g->fitted.size(), VMM(ncomponent));
+
+    for(int m = 0; m < (int)g->fitted.size(); ++m)
+    {
+        if(!read_raw(in, g->fitted[m]))
+            return false;
+        if(!g->fitted[m])
+            continue;
+        bool ok = dist == GUIDE_DIST::GUIDE_GMM ? g->models[m].read(in) : g->spheres[m].read(in);
+        if(!ok || (dist == GUIDE_DIST::GUIDE_GMM ? g->models[m].size() : g->spheres[m].size()) != ncomponent)
+            return false;
+    }
+
+    // whatever fit was in flight is older than the file
+    publish();
+    owner = std::move(g);
+    current.store(owner.get(), std::memory_order_release);
+    return true;
+}
+
+void path_guide::fit(guide_model& g, std::vector<guide_sample> samples)
+{
+    // the same set in the same order whichever thread traced which tile
+    std::sort(samples.begin(), samples.end(), [](const guide_sample& a, const guide_sample& b) {
+        if(a.p.x != b.p.x) return a.p.x < b.p.x;
+        if(a.p.y != b.p.y) return a.p.y < b.p.y;
+        if(a.p.z != b.p.z) return a.p.z < b.p.z;
+        if(a.dir.x != b.dir.x) return a.dir.x < b.dir.x;
+        if(a.dir.y != b.dir.y) return a.dir.y < b.dir.y;
+        return a.dir.z < b.dir.z;
+    });
+
+    if(g.regions.empty())
+        build_regions(g, samples);
+
+    // model of every sample, then a stable counting sort by model
+    const int n = samples.size(), nmodel = g.fitted.size(), per = per_region();
+    const int grain = 4096;
+    std::vector<int> model_of(n);
+    trainers.parallel_for((n + grain - 1) / grain, [&](int t, int) {
+        for(int i = t * grain; i < std::min(n, (t + 1) * grain); ++i)
+            model_of[i] = g.region(samples[i].p) * per + (per == 6 ? samples[i].hemisphere : 0);
+    });
+
+    std::vector<int> start(nmodel + 1, 0);
+    for(int i = 0; i < n; ++i)
+        start[model_of[i] + 1]++;
+    for(int m = 0; m < nmodel; ++m)
+        start[m + 1] += start[m];
+    std::vector<int> order(n);
+    std::vector<int> slot(start.begin(), start.end() - 1);
+    for(int i = 0; i < n; ++i)
+        order[slot[model_of[i]]++] = i;
+
+    // models are independent, one task each, but a model with many samples to fit would keep its task
+    // running long after the others, so those fit afterwards, one at a time with their E-steps on the pool
+    const int min_samples = 8 * ncomponent;
+    auto train = [&](int m, thread_pool* p) {
+        int count = start[m + 1] - start[m];
+        std::vector<double> x(count), y(count), z(count), w(count);
+        for(int k = 0; k < count; ++k)
+        {
+            const guide_sample& s = samples[order[start[m] + k]];
+            if(dist == GUIDE_DIST::GUIDE_GMM)
+                x[k] = s.square.x, y[k] = s.square.y;
+            else
+                x[k] = s.dir.x, y[k] = s.dir.y, z[k] = s.dir.z;
+            w[k] = s.w;
+        }
+
+        // the VMM E-step is cheap enough that its fit does not split
+        if(!g.fitted[m])
+        {
+            if(dist == GUIDE_DIST::GUIDE_GMM)
+                g.models[m].offline_trainModel(x.data(), y.data(), w.data(), count, p);
+            else
+                g.spheres[m].offline_trainModel(x.data(), y.data(), z.data(), w.data(), count);
+            g.fitted[m] = 1;
+        }
+        else
+            for(int k = 0; k < count; k += online_batch)
+            {
+                int b = std::min(online_batch, count - k);
+                if(dist == GUIDE_DIST::GUIDE_GMM)
+                    g.models[m].online_trainModel(x.data() + k, y.data() + k, w.data() + k, b);
+                else
+                    g.spheres[m].online_trainModel(x.data() + k, y.data() + k, z.data() + k, w.data() + k, b);
+            }
+    };
+
+    std::vector<char> large(nmodel);
+    for(int m = 0; m < nmodel; ++m)
+        large[m] = dist == GUIDE_DIST::GUIDE_GMM && !g.fitted[m] && start[m + 1] - start[m] >= large_fit;
+
+    trainers.parallel_for(nmodel, [&](int m, int) {
+        int count = start[m + 1] - start[m];
+        if(count == 0 || (!g.fitted[m] && count < min_samples) || large[m])
+            return;
+        train(m, nullptr);
+    });
+    for(int m = 0; m < nmodel; ++m)
+        if(large[m])
+            train(m, &trainers);
+}
+
+int path_guide::size() const
+{
+    const guide_model* g = current.load(std::memory_order_acquire);
+    return g ? g->regions.size() : 0;
+}
+
+size_t path_guide::queue_depth() const
+{
+    size_t d = 0;
+    for(auto& r : rings)
+        d += r->depth();
+    return d;
+}
+
+size_t path_guide::max_queue_depth() const
+{
+    size_t d = 0;
+    for(auto& r : rings)
+        d = std::max(d, r->max_depth());
+    return d;
+}
+
+long long path_guide::dropped() const
+{
+    long long d = 0;
+    for(auto& r : rings)
+        d += r->dropped();
+    return d;
+}
+
+guide_pdf path_guide::lookup(const point& p, const direction& n) const
+{
+    guide_pdf out;
+    const guide_model* g = current.load(std::memory_order_acquire);
+    if(!g)
+        return out;
+
+    if(dist == GUIDE_DIST::GUIDE_GMM)
+    {
+        int m = g->region(p) * 6 + gmm_pdf::nearest_hemisphere(n);
+        if(g->fitted[m])
+            out.gaussian = gmm_pdf(&g->models[m], m % 6);
+    }
+    else
+    {
+        int m = g->region(p);
+        if(g->fitted[m])
+            out.spherical = vmm_pdf(&g->spheres[m], n);
+    }
+    return out;
+}
+
+void path_guide::record(thread_context& ctx, const guide_vertex* v, int n, const color& L)
+{
+    spsc_ring<guide_sample>& out = *rings[ctx.id];
+    for(int i = 0; i < n; ++i)
+    {
+        // radiance through the bounce, channel by channel
+        color d = L - v[i].L;
+        double Li = 0.0;
+        for(double c : { d.x / v[i].beta.x, d.y / v[i].beta.y, d.z / v[i].beta.z })
+            if(std::isfinite(c) && c > 0)
+                Li += c / 3;
+
+        guide_sample s { v[i].p, v[i].hemisphere, v[i].dir, coord(0, 0), Li * v[i].cosine / v[i].pdf };
+        if(dist == GUIDE_DIST::GUIDE_GMM && !gmm_pdf::to_square(s.dir, s.hemisphere, s.square))
+            continue;
+        if(s.w > 0 && std::isfinite(s.w))
+            out.push(s);
+    }
+}
\ No newline at end of file
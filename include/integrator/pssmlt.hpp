@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "math/ray.hpp"
+#include "math/rng.hpp"
+#include "camera/framebuffer.hpp"
+#include "camera/splatbuffer.hpp"
+#include "pdf/alias_table.hpp"
+#include "sampler/sampler.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+
+// a coordinate of the primary sample vector, with what it was before the current mutation
+class primary_sample
+{
+public:
+    double value, backup;
+    long long modified, modified_backup;       // iteration of the last change
+};
+
+/*
+    a point of primary sample space (Kelemen et al. 2002), the sampler a path tracer reads its
+    uniforms from, so the path is a function of the vector; as pbrt's MLTSampler, coordinates
+    mutate lazily when they are read, to catch up with every iteration they missed
+        large step: a fresh uniform, the chain jumps anywhere
+        small step: a normal offset of sigma per missed iteration, wrapped into [0, 1)
+    reject puts back every coordinate the iteration changed
+*/
+class pss_sampler : public sampler
+{
+private:
+    pcg32 rng;
+    std::vector<primary_sample> X;
+    double sigma;
+    double large_step_probability;
+    long long iteration, last_large_step;
+    bool large_step;
+
+    void ensure_ready(int i);
+
+public:
+    pss_sampler(uint64_t _seed = 0, double _sigma = 0.01, double _large_step_probability = 0.3);
+
+    // back to an empty vector whose first iteration is a large step, as a new sampler of that seed
+    void reset(uint64_t _seed);
+
+    void start_iteration();
+    void accept();
+    void reject();
+    inline bool is_large_step() const { return large_step; }
+
+    // every path restarts at the first coordinate, the pixel comes from the vector itself
+    virtual void start_pixel_sample(int /*_row*/, int /*_col*/, int /*_index*/) override { dim = 0; }
+    virtual double get_1d() override { ensure_ready(dim); return X[dim++].value; }
+    virtual vec2<double> get_2d() override { double x = get_1d(); return vec2<double>(x, get_1d()); }
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<pss_sampler>(*this); }
+};
+
+/*
+    primary sample space Metropolis light transport (Kelemen et al. 2002) over any path tracer:
+    path(ray, thread_context&) reads its uniforms from a pss_sampler, the first two pick the point
+    on the film, so the luminance of its result is a function I(u) of the vector u
+
+        bootstrap: I of `bootstrap` independent vectors, b = their mean is the image's total
+                   luminance over [0, 1)^2, the normalization Metropolis itself cannot give
+        chains:    independent chains on the pool, each starts at a bootstrap vector picked by I and
+                   proposes large or small steps, accepted with min(1, I(proposed) / I(current));
+                   both states splat their colour over I, weighted by the acceptance and its
+                   complement, so no proposal is thrown away
+
+    the image is the splats times b * pixels / mutations; splats are fixed point, so the image
+    is the same for any thread count, bootstrap vector k is seeded by k and chain c by c
+    a Metropolis chain spends its time where the image is bright, paths only a small step from
+    each other (caustics, light through a gap) are found once and then explored
+*/
+class pssmlt_integrator
+{
+private:
+    const scene& sc;
+    int nchain;
+    int nbootstrap;
+    double sigma;
+    double large_step_probability;
+    uint64_t seed;
+
+    double b;                   // of the last render
+    long long proposed, accepted;
+
+    static const int bootstrap_chunk = 4096;
+
+    static inline double luminance(const color& c) { return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z; }
+
+    template <class F>
+    color contribution(F& path, thread_context& ctx, int width, int height, int& row, int& col) const;
+
+public:
+    pssmlt_integrator(const scene& _sc, int _chains = 64, int _bootstrap = 100000, double _sigma = 0.01,
+                      double _large_step_probability = 0.3, uint64_t _seed = 0);
+
+    // mutations_per_pixel * width * height mutations over all chains
+    template <class F>
+    render_stats render(FrameBuffer& fb, thread_pool& pool, int mutations_per_pixel, F&& path);
+
+    inline double normalization() const { return b; }
+    inline double acceptance() const { return proposed > 0 ? (double)accepted / proposed : 0.0; }
+};
+
+#include "pssmlt.inl"
\ No newline at end of file
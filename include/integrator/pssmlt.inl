@@ -0,0 +1,180 @@
+#include "pssmlt.hpp"
+
+pss_sampler::pss_sampler(uint64_t _seed, double _sigma, double _large_step_probability)
+    : sampler(_seed), sigma(_sigma), large_step_probability(_large_step_probability)
+{
+    reset(_seed);
+}
+
+void pss_sampler::reset(uint64_t _seed)
+{
+    seed_value = _seed;
+    rng.seed(mix_bits(_seed));
+    X.clear();
+    iteration = 0;
+    last_large_step = 0;
+    large_step = true;
+    dim = 0;
+}
+
+void pss_sampler::ensure_ready(int i)
+{
+    if(i >= (int)X.size())
+        X.resize(i + 1, primary_sample { 0.0, 0.0, 0, 0 });
+    primary_sample& x = X[i];
+
+    // a coordinate not read since the last accepted large step takes the value that step gave it
+    if(x.modified < last_large_step)
+    {
+        x.value = rng.next_double();
+        x.modified = last_large_step;
+    }
+
+    x.backup = x.value;
+    x.modified_backup = x.modified;
+    if(large_step)
+        x.value = rng.next_double();
+    else
+    {
+        // Box-Muller, one normal per missed iteration adds up to sigma * sqrt(missed)
+        long long missed = iteration - x.modified;
+        double u1 = 1.0 - rng.next_double(), u2 = rng.next_double();
+        double normal = std::sqrt(-2.0 * std::log(u1)) * std::cos(2 * PI * u2);
+        x.value += normal * sigma * std::sqrt((double)missed);
+        x.value -= std::floor(x.value);
+    }
+    x.modified = iteration;
+}
+
+void pss_sampler::start_iteration()
+{
+    iteration++;
+    large_step = rng.next_double() < large_step_probability;
+    dim = 0;
+}
+
+void pss_sampler::accept()
+{
+    if(large_step)
+        last_large_step = iteration;
+}
+
+void pss_sampler::reject()
+{
+    for(primary_sample& x : X)
+        if(x.modified == iteration)
+        {
+            x.value = x.backup;
+            x.modified = x.modified_backup;
+        }
+    iteration--;
+}
+
+pssmlt_integrator::pssmlt_integrator(const scene& _sc, int _chains, int _bootstrap, double _sigma, double _large_step_probability, uint64_t _seed)
+    : sc(_sc), nchain(_chains), nbootstrap(_bootstrap), sigma(_sigma), large_step_probability(_large_step_probability), seed(_seed),
+      b(0.0), proposed(0), accepted(0) {}
+
+template <class F>
+color pssmlt_integrator::contribution(F& path, thread_context& ctx, int width, int height, int& row, int& col) const
+{
+    ctx.smp->start_pixel_sample(0, 0, 0);
+    coord u = ctx.smp->get_2d();
+    row = std::min((int)(u.x * height), height - 1);
+    col = std::min((int)(u.y * width), width - 1);
+    ctx.pixel = row * width + col;
+
+    color L = path(sc.camera.get_ray(u.y, u.x), ctx);
+    return luminance(L) > 0 && std::isfinite(luminance(L)) ? L : color(0.0);
+}
+
+template <class F>
+render_stats pssmlt_integrator::render(FrameBuffer& fb, thread_pool& pool, int mutations_per_pixel, F&& path)
+{
+    auto start = std::chrono::steady_clock::now();
+    const int width = fb.get_width(), height = fb.get_height();
+
+    std::vector<thread_context> ctx(pool.size());
+    for(int i = 0; i < pool.size(); ++i)
+    {
+        ctx[i].id = i;
+        ctx[i].smp = std::make_unique<pss_sampler>(0, sigma, large_step_probability);
+    }
+
+    // bootstrap, vector k replays from the seed hash_combine(seed, k)
+    std::vector<double> weights(nbootstrap);
+    pool.parallel_for((nbootstrap + bootstrap_chunk - 1) / bootstrap_chunk, [&](int c, int id) {
+        pss_sampler& s = static_cast<pss_sampler&>(*ctx[id].smp);
+        int row, col;
+        for(int k = c * bootstrap_chunk; k < std::min(nbootstrap, (c + 1) * bootstrap_chunk); ++k)
+        {
+            s.reset(hash_combine(seed, k));
+            weights[k] = luminance(contribution(path, ctx[id], width, height, row, col));
+        }
+    });
+
+    double sum = 0.0;
+    for(double w : weights)
+        sum += w;
+    b = nbootstrap > 0 ? sum / nbootstrap : 0.0;
+
+    SplatBuffer splats(width, height);
+    long long total = (long long)mutations_per_pixel * width * height;
+    std::vector<long long> chain_accepted(nchain, 0);
+    if(b > 0)
+    {
+        alias_table starts(weights);
+        pool.parallel_for(nchain, [&](int c, int id) {
+            pss_sampler& s = static_cast<pss_sampler&>(*ctx[id].smp);
+            pcg32 rng(hash_combine(seed, c), 0x6d6c74);
+
+            double rest;
+            s.reset(hash_combine(seed, starts.sample(rng.next_double(), rest)));
+            int row, col;
+            color L = contribution(path, ctx[id], width, height, row, col);
+            double I = luminance(L);
+
+            long long n = total / nchain + (c < total % nchain ? 1 : 0);
+            for(long long k = 0; k < n; ++k)
+            {
+                s.start_iteration();
+                int prow, pcol;
+                color Lp = contribution(path, ctx[id], width, height, prow, pcol);
+                double Ip = luminance(Lp);
+
+                double a = std::min(1.0, Ip / I);
+                if(a > 0)
+                    splats.add(prow, pcol, Lp * (a / Ip));
+                splats.add(row, col, L * ((1 - a) / I));
+
+                if(rng.next_double() < a)
+                {
+                    L = Lp, I = Ip, row = prow, col = pcol;
+                    s.accept();
+                    chain_accepted[c]++;
+                }
+                else
+                    s.reject();
+            }
+            ctx[id].samples += n;
+        });
+    }
+
+    double scale = total > 0 ? b * width * height / total : 0.0;
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+            fb.set_pixel(i, j, splats.get(i, j) * scale);
+
+    proposed = b > 0 ? total : 0;
+    accepted = 0;
+    for(long long a : chain_accepted)
+        accepted += a;
+
+    render_stats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for(const auto& c : ctx)
+    {
+        stats.rays += c.rays;
+        stats.samples += c.samples;
+    }
+    return stats;
+}
\ No newline at end of file
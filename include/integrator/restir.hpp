@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "math/ray.hpp"
+#include "camera/framebuffer.hpp"
+#include "camera/reservoirbuffer.hpp"
+#include "material/material.hpp"
+#include "pdf/alias_table.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+
+// the first non-specular surface seen through a pixel in one pass
+class shading_point
+{
+public:
+    hit_record rec;
+    direction wo;           // unit, toward the camera
+    color beta;             // camera throughput up to here, specular bounces included
+    color attenuation;
+    bool valid;
+};
+
+/*
+    direct light by reservoir-based spatiotemporal importance resampling (ReSTIR, Bitterli et al. 2020)
+    every pass
+        camera:  trace each pixel through specular bounces to a shading point, add emission on the
+                 way, then resample candidates points on the lights into the pixel's reservoir by the
+                 unshadowed contribution p = luminance(f Le G), each from a light picked in O(1) by
+                 its power, then uniform over its area; one shadow ray for the survivor, which
+                 is dropped (W = 0) when occluded; with temporal reuse the reservoir of the pixel from
+                 the pass before joins it, its M capped at max_history * candidates
+        spatial: the reservoir joins spatial_taps others from random pixels within spatial_radius,
+                 then the pixel adds W f Le G of the survivor
+
+    reservoirs join with weight p(y) W M and the result is weighted 1 / Z, Z the M of those whose own
+    shading point sees the survivor with p > 0 (Algorithm 6 of the paper), which takes one shadow
+    ray per joined reservoir and keeps the estimate unbiased; W > 0 always means the pixel's own
+    point sees y, so shading needs no more rays
+
+    the camera and spatial phases read only what the phase before wrote, and take the sampler
+    streams of pixel (i, j) and (height + i, j), so the image is the same for any thread count
+    a pixel is Ld / passes, readable after any pass
+    candidates come only from emitters with an area, environment light is left out
+*/
+class restir_integrator
+{
+private:
+    const scene& sc;
+    int max_depth;
+    int candidates;
+    bool temporal;
+    int spatial_taps;
+    double spatial_radius;      // in pixels
+    double max_history;
+
+    std::vector<const geometry*> emitters;      // the lights with an area
+    alias_table emitter_table;                  // by power
+
+    int width, height;
+    int npass;
+    std::vector<shading_point> points, prev_points;
+    ReservoirBuffer current;            // after the camera phase
+    ReservoirBuffer history;            // of the pass before, after its spatial phase
+    std::vector<color> Ld;              // emission and direct light, summed over passes
+
+    color unshadowed(const shading_point& sp, const light_point& y) const;
+    double target(const shading_point& sp, const light_point& y) const;
+    bool candidate(sampler& s, light_point& y, double& pdf_A) const;
+    bool visible(const shading_point& sp, const light_point& y, thread_context& ctx) const;
+
+    // reservoirs rs[k] of the points pts[k] resampled for pts[0], which is the pixel's own
+    reservoir combine(const reservoir* rs, const shading_point* const* pts, int n, sampler& s, thread_context& ctx) const;
+
+    void camera_pass(int i, int j, thread_context& ctx);
+    void spatial_pass(int i, int j, ReservoirBuffer& out, thread_context& ctx);
+
+public:
+    static const int max_taps = 16;
+
+    restir_integrator(const scene& _sc, int _max_depth, int _candidates = 32, bool _temporal = true, int _spatial_taps = 4,
+                      double _spatial_radius = 16.0, double _max_history = 20.0);
+
+    void begin(int _width, int _height);
+    render_stats pass(thread_pool& pool, const sampler& proto = independent_sampler());
+    void output(FrameBuffer& fb) const;
+
+    inline int passes() const { return npass; }
+
+    render_stats render(FrameBuffer& fb, thread_pool& pool, int passes, const sampler& proto = independent_sampler());
+};
+
+#include "restir.inl"
\ No newline at end of file
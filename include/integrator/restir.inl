@@ -0,0 +1,279 @@
+#include "restir.hpp"
+
+restir_integrator::restir_integrator(const scene& _sc, int _max_depth, int _candidates, bool _temporal, int _spatial_taps,
+                                     double _spatial_radius, double _max_history)
+    : sc(_sc), max_depth(_max_depth), candidates(_candidates), temporal(_temporal),
+      spatial_taps(std::min(_spatial_taps, max_taps)), spatial_radius(_spatial_radius), max_history(_max_history),
+      width(0), height(0), npass(0)
+{
+    // power from one point of each light, every light keeps some of the mean, so a textured light
+    // whose point came out black can still be picked
+    independent_sampler s(0x5eed);
+    s.start_pixel_sample(0, 0, 0);
+    std::vector<double> power;
+    double total = 0.0;
+    for(const auto& l : sc.lights->objects)
+    {
+        hit_record rec;
+        double pdf_A;
+        if(l->area() <= 0 || !l->sample_surface(s, rec, pdf_A))
+            continue;
+        color Le = rec.hit_mat->emitted(rec.uv);
+        emitters.push_back(l.get());
+        power.push_back(l->area() * (0.2126 * Le.x + 0.7152 * Le.y + 0.0722 * Le.z));
+        total += power.back();
+    }
+    for(double& w : power)
+        w = std::max(w, 0.01 * total / power.size());
+    if(!power.empty())
+        emitter_table = alias_table(power);
+}
+
+bool restir_integrator::candidate(sampler& s, light_point& y, double& pdf_A) const
+{
+    if(emitters.empty())
+        return false;
+    double rest;
+    int k = emitter_table.sample(s.get_1d(), rest);
+
+    hit_record rec;
+    if(!emitters[k]->sample_surface(s, rec, pdf_A))
+        return false;
+    pdf_A *= emitter_table.pmf(k);
+    y = light_point { rec.p, rec.normal, rec.hit_mat->emitted(rec.uv) };
+    return true;
+}
+
+color restir_integrator::unshadowed(const shading_point& sp, const light_point& y) const
+{
+    direction d = y.p - sp.rec.p;
+    double dist2 = d.length_square();
+    double cos_light = fabs(dot(y.n, d)) / sqrt(dist2);
+    if(cos_light < EPS)
+        return color(0.0);
+
+    ray in(sp.rec.p + sp.wo, -sp.wo);
+    double f = sp.rec.hit_mat->brdf_cos(in, sp.rec, ray(sp.rec.p, d));
+    if(f <= 0)
+        return color(0.0);
+
+    return y.Le * sp.attenuation * (f * cos_light / dist2);
+}
+
+double restir_integrator::target(const shading_point& sp, const light_point& y) const
+{
+    color c = unshadowed(sp, y);
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
+bool restir_integrator::visible(const shading_point& sp, const light_point& y, thread_context& ctx) const
+{
+    direction d = y.p - sp.rec.p;
+    hit_record rec;
+    ctx.rays++;
+    return !sc.world.hit(ray(sp.rec.p, d), rec, interval(0.001, d.length() - 0.001));
+}
+
+reservoir restir_integrator::combine(const reservoir* rs, const shading_point* const* pts, int n, sampler& s, thread_context& ctx) const
+{
+    reservoir out;
+    for(int k = 0; k < n; ++k)
+        out.update(rs[k].y, target(*pts[0], rs[k].y) * rs[k].W * rs[k].M, rs[k].M, s.get_1d());
+    if(out.w_sum <= 0)
+        return out;
+
+    // the own point first, a survivor it cannot see lights nothing here and is dropped
+    if(!visible(*pts[0], out.y, ctx))
+        return out;
+    double Z = rs[0].M;
+    for(int k = 1; k < n; ++k)
+        if(target(*pts[k], out.y) > 0 && visible(*pts[k], out.y, ctx))
+            Z += rs[k].M;
+
+    double p = target(*pts[0], out.y);
+    out.W = p > 0 ? out.w_sum / (Z * p) : 0.0;
+    return out;
+}
+
+void restir_integrator::camera_pass(int i, int j, thread_context& ctx)
+{
+    const int idx = i * width + j;
+    shading_point& sp = points[idx];
+    sp.valid = false;
+    reservoir& cur = current.at(i, j);
+    cur = reservoir();
+
+    sampler& s = *ctx.smp;
+    s.start_pixel_sample(i, j, npass);
+    coord jitter = s.get_2d();
+    ray r = sc.camera.get_ray((j + jitter.y) / width, (i + jitter.x) / height);
+
+    color beta(1.0);
+    for(int depth = 0; depth <= max_depth; ++depth)
+    {
+        hit_record rec;
+        ctx.rays++;
+        if(!sc.world.hit(r, rec))
+            break;
+
+        Ld[idx] = Ld[idx] + beta * rec.hit_mat->emitted(rec.uv);
+
+        scatter_record srec;
+        if(depth == max_depth || !rec.hit_mat->scatter(r, rec, srec, s))
+            break;
+
+        if(!srec.is_specular)
+        {
+            sp.rec = rec;
+            sp.wo = -r.get_dir();
+            sp.beta = beta;
+            sp.attenuation = srec.attenuation;
+            sp.valid = true;
+            break;
+        }
+
+        beta = beta * srec.attenuation;
+        r = srec.specular_ray;
+    }
+    ctx.samples++;
+    if(!sp.valid)
+        return;
+
+    // resampled importance sampling of the candidates
+    for(int k = 0; k < candidates; ++k)
+    {
+        light_point y;
+        double pdf_A;
+        double u = s.get_1d();
+        if(!candidate(s, y, pdf_A))
+        {
+            cur.M += 1;
+            continue;
+        }
+        cur.update(y, target(sp, y) / pdf_A, 1, u);
+    }
+    double p = cur.w_sum > 0 ? target(sp, cur.y) : 0.0;
+    if(p > 0 && visible(sp, cur.y, ctx))
+        cur.W = cur.w_sum / (cur.M * p);
+
+    if(temporal && npass > 0 && prev_points[idx].valid)
+    {
+        reservoir rs[2] = { cur, history.at(i, j) };
+        rs[1].M = std::min(rs[1].M, max_history * candidates);
+        const shading_point* pts[2] = { &sp, &prev_points[idx] };
+        cur = combine(rs, pts, 2, s, ctx);
+    }
+}
+
+void restir_integrator::spatial_pass(int i, int j, ReservoirBuffer& out, thread_context& ctx)
+{
+    const int idx = i * width + j;
+    const shading_point& sp = points[idx];
+    out.at(i, j) = current.at(i, j);
+    if(!sp.valid)
+        return;
+
+    sampler& s = *ctx.smp;
+    s.start_pixel_sample(height + i, j, npass);
+
+    reservoir rs[max_taps + 1];
+    const shading_point* pts[max_taps + 1];
+    int n = 0;
+    rs[n] = current.at(i, j), pts[n] = &sp, n++;
+    for(int t = 0; t < spatial_taps; ++t)
+    {
+        coord u = s.get_2d();
+        double radius = spatial_radius * sqrt(u.x), phi = 2 * PI * u.y;
+        int a = i + (int)std::lround(radius * sin(phi)), b = j + (int)std::lround(radius * cos(phi));
+        if(a < 0 || a >= height || b < 0 || b >= width || (a == i && b == j))
+            continue;
+
+        // a neighbor on another surface rarely sees the same light, skipping it only saves shadow rays
+        const shading_point& q = points[a * width + b];
+        if(!q.valid || dot(q.rec.normal, sp.rec.normal) < 0.9)
+            continue;
+        rs[n] = current.at(a, b), pts[n] = &q, n++;
+    }
+
+    reservoir& r = out.at(i, j);
+    if(n > 1)
+        r = combine(rs, pts, n, s, ctx);
+
+    if(r.W > 0)
+        Ld[idx] = Ld[idx] + sp.beta * unshadowed(sp, r.y) * r.W;
+}
+
+void restir_integrator::begin(int _width, int _height)
+{
+    width = _width, height = _height;
+    npass = 0;
+
+    shading_point sp;
+    sp.valid = false;
+    points.assign(width * height, sp);
+    prev_points.assign(width * height, sp);
+    current = ReservoirBuffer(width, height);
+    history = ReservoirBuffer(width, height);
+    Ld.assign(width * height, color(0.0));
+}
+
+render_stats restir_integrator::pass(thread_pool& pool, const sampler& proto)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<thread_context> ctx(pool.size());
+    for(int i = 0; i < pool.size(); ++i)
+    {
+        ctx[i].id = i;
+        ctx[i].smp = proto.clone();
+    }
+
+    pool.parallel_for(height, [&](int i, int id) {
+        for(int j = 0; j < width; ++j)
+            camera_pass(i, j, ctx[id]);
+    });
+
+    ReservoirBuffer reused(width, height);
+    pool.parallel_for(height, [&](int i, int id) {
+        for(int j = 0; j < width; ++j)
+            spatial_pass(i, j, reused, ctx[id]);
+    });
+
+    // this pass is the history of the next
+    std::swap(history, reused);
+    std::swap(prev_points, points);
+    npass++;
+
+    render_stats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for(const auto& c : ctx)
+    {
+        stats.rays += c.rays;
+        stats.samples += c.samples;
+    }
+    return stats;
+}
+
+void restir_integrator::output(FrameBuffer& fb) const
+{
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+            fb.set_pixel(i, j, Ld[i * width + j] / std::max(npass, 1));
+}
+
+render_stats restir_integrator::render(FrameBuffer& fb, thread_pool& pool, int passes, const sampler& proto)
+{
+    begin(fb.get_width(), fb.get_height());
+
+    render_stats stats;
+    for(int k = 0; k < passes; ++k)
+    {
+        render_stats s = pass(pool, proto);
+        stats.seconds += s.seconds;
+        stats.rays += s.rays;
+        stats.samples += s.samples;
+    }
+
+    output(fb);
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include "math/ray.hpp"
+#include "camera/framebuffer.hpp"
+#include "material/material.hpp"
+#include "pdf/pdf.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+#include "kdtree/photon_map.hpp"
+
+// the first non-specular surface seen through a pixel, with the progressive estimate of its radiance
+class visible_point
+{
+public:
+    hit_record rec;
+    direction wo;           // unit, toward the camera
+    color beta;             // camera throughput up to here, specular bounces included
+    color attenuation;
+    bool valid;
+
+    double radius;
+    double n;               // accumulated photon count
+    color tau;              // accumulated flux, times the current radius squared over the old
+    color Ld;               // emission and direct light, summed over passes
+};
+
+/*
+    stochastic progressive photon mapping (Hachisuka and Jensen 2009), every pass
+        camera: trace each pixel through specular bounces to a visible point, add emission on the
+                way and next event estimation at the visible point
+        photon: trace photons from the lights in parallel chunks, store every non-specular hit
+                after the first bounce (direct light is the camera pass's job) in a photon_map
+        gather: each visible point collects the photons within its radius, then
+                    n' = n + alpha * m, r' = r * sqrt(n' / (n + m)), tau' = (tau + phi) * r'^2 / r^2
+
+    a pixel is Ld / passes + tau / (passes * photons_per_pass * pi * r^2), readable after any pass
+    caustics seen through glass reach the diffuse surfaces as photons, so they converge at the rate
+    of the photon density instead of waiting for a camera path to hit the light
+
+    photons leave only emitters with an area and the camera pass ignores the environment, so
+    environment light is missing from the image
+*/
+class sppm_integrator
+{
+private:
+    const scene& sc;
+    int max_depth;
+    double initial_radius;      // 0 picks 1/50 of the scene diagonal
+    double alpha;
+
+    static const int photon_chunk = 4096;
+
+    int width, height;
+    int photons_per_pass;
+    int npass;
+    std::vector<visible_point> points;
+    std::vector<std::vector<photon> > chunks;   // photons of one pass, per chunk, reused
+    photon_map photons;
+
+    color direct_light(const visible_point& vp, sampler& s, thread_context& ctx) const;
+    void camera_pass(int i, int j, thread_context& ctx);
+    void trace_photon(std::vector<photon>& out, thread_context& ctx) const;
+    void gather(visible_point& vp) const;
+
+public:
+    sppm_integrator(const scene& _sc, int _max_depth, double _initial_radius = 0.0, double _alpha = 2.0 / 3.0);
+
+    // resets the estimate, photons_per_pass 0 means one per pixel
+    void begin(int _width, int _height, int _photons_per_pass = 0);
+    render_stats pass(thread_pool& pool, const sampler& proto = independent_sampler());
+    void output(FrameBuffer& fb) const;
+
+    inline int passes() const { return npass; }
+
+    render_stats render(FrameBuffer& fb, thread_pool& pool, int passes, const sampler& proto = independent_sampler());
+};
+
+#include "sppm.inl"
\ No newline at end of file
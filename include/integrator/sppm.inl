@@ -0,0 +1,253 @@
+#include "sppm.hpp"
+
+sppm_integrator::sppm_integrator(const scene& _sc, int _max_depth, double _initial_radius, double _alpha)
+    : sc(_sc), max_depth(_max_depth), initial_radius(_initial_radius), alpha(_alpha),
+      width(0), height(0), photons_per_pass(0), npass(0) {}
+
+color sppm_integrator::direct_light(const visible_point& vp, sampler& s, thread_context& ctx) const
+{
+    hit_record l_rec;
+    double pdf_A;
+    if(!sc.lights->sample_surface(s, l_rec, pdf_A))
+        return color(0.0);
+
+    direction d = l_rec.p - vp.rec.p;
+    double dist2 = d.length_square();
+    double cos_light = fabs(dot(l_rec.normal, d)) / sqrt(dist2);
+
+    ray in(vp.rec.p + vp.wo, -vp.wo);
+    ray to_light(vp.rec.p, d);
+    double f = vp.rec.hit_mat->brdf_cos(in, vp.rec, to_light);
+    if(f <= 0 || cos_light < EPS)
+        return color(0.0);
+
+    hit_record rec;
+    ctx.rays++;
+    if(sc.world.hit(to_light, rec, interval(0.001, sqrt(dist2) - 0.001)))
+        return color(0.0);
+
+    return l_rec.hit_mat->emitted(l_rec.uv) * vp.attenuation * (f * cos_light / (dist2 * pdf_A));
+}
+
+void sppm_integrator::camera_pass(int i, int j, thread_context& ctx)
+{
+    visible_point& vp = points[i * width + j];
+    vp.valid = false;
+
+    sampler& s = *ctx.smp;
+    s.start_pixel_sample(i, j, npass);
+    coord jitter = s.get_2d();
+    ray r = sc.camera.get_ray((j + jitter.y) / width, (i + jitter.x) / height);
+
+    color beta(1.0);
+    for(int depth = 0; depth <= max_depth; ++depth)
+    {
+        hit_record rec;
+        ctx.rays++;
+        if(!sc.world.hit(r, rec))
+            break;
+
+        vp.Ld = vp.Ld + beta * rec.hit_mat->emitted(rec.uv);
+
+        scatter_record srec;
+        if(depth == max_depth || !rec.hit_mat->scatter(r, rec, srec, s))
+            break;
+
+        if(!srec.is_specular)
+        {
+            vp.rec = rec;
+            vp.wo = -r.get_dir();
+            vp.beta = beta;
+            vp.attenuation = srec.attenuation;
+            vp.valid = true;
+            vp.Ld = vp.Ld + beta * direct_light(vp, s, ctx);
+            break;
+        }
+
+        beta = beta * srec.attenuation;
+        r = srec.specular_ray;
+    }
+    ctx.samples++;
+}
+
+void sppm_integrator::trace_photon(std::vector<photon>& out, thread_context& ctx) const
+{
+    sampler& s = *ctx.smp;
+
+    hit_record l_rec;
+    double pdf_A;
+    if(!sc.lights->sample_surface(s, l_rec, pdf_A))
+        return;
+
+    // cosine-weighted emission from a random side, as the light subpaths of BDPT
+    direction n = s.get_1d() < 0.5 ? l_rec.normal : -l_rec.normal;
+    cosine_pdf cp(n);
+    direction d = cp.generate(s);
+    double cos_light = dot(n, d);
+    if(cos_light <= 0)
+        return;
+
+    double emission_pdf = pdf_A * cos_light / PI * 0.5;
+    color beta = l_rec.hit_mat->emitted(l_rec.uv) * cos_light / emission_pdf;
+
+    ray r(l_rec.p, d);
+    for(int depth = 0; depth < max_depth; ++depth)
+    {
+        hit_record rec;
+        ctx.rays++;
+        if(!sc.world.hit(r, rec))
+            break;
+
+        scatter_record srec;
+        if(!rec.hit_mat->scatter(r, rec, srec, s))
+            break;
+
+        if(srec.is_specular)
+        {
+            beta = beta * srec.attenuation;
+            r = srec.specular_ray;
+            continue;
+        }
+
+        if(depth > 0)
+            out.push_back(photon{rec.p, -r.get_dir(), beta});
+
+        ray scattered(rec.p, srec.brdf_pdf.generate(s));
+        double pdf = srec.brdf_pdf.value(scattered.get_dir());
+        double f = rec.hit_mat->brdf_cos(r, rec, scattered);
+        if(pdf <= 0 || f <= 0)
+            break;
+
+        beta = beta * srec.attenuation * (f / pdf);
+        r = scattered;
+    }
+}
+
+void sppm_integrator::gather(visible_point& vp) const
+{
+    if(!vp.valid)
+        return;
+
+    ray in(vp.rec.p + vp.wo, -vp.wo);
+    color phi(0.0);
+    int m = 0;
+    photons.range(vp.rec.p, vp.radius, [&](const photon& ph, double) {
+        // the photon's flux arrives through the BRDF alone, its cosine is already in the density
+        double cosine = dot(vp.rec.normal, ph.wi);
+        if(cosine <= 0)
+            return;
+        double f = vp.rec.hit_mat->brdf_cos(in, vp.rec, ray(vp.rec.p, ph.wi)) / cosine;
+        phi = phi + ph.power * f;
+        m++;
+    });
+    if(m == 0)
+        return;
+
+    double n = vp.n + alpha * m;
+    double radius = vp.radius * sqrt(n / (vp.n + m));
+    vp.tau = (vp.tau + vp.beta * vp.attenuation * phi) * (radius * radius / (vp.radius * vp.radius));
+    vp.n = n;
+    vp.radius = radius;
+}
+
+void sppm_integrator::begin(int _width, int _height, int _photons_per_pass)
+{
+    width = _width, height = _height;
+    photons_per_pass = _photons_per_pass > 0 ? _photons_per_pass : width * height;
+    npass = 0;
+
+    double r0 = initial_radius;
+    if(r0 <= 0)
+    {
+        AABB box = sc.world.bounding_box();
+        r0 = (box.maximum - box.minimum).length() / 50.0;
+    }
+
+    visible_point vp;
+    vp.valid = false;
+    vp.radius = r0;
+    vp.n = 0.0;
+    vp.tau = vp.Ld = color(0.0);
+    points.assign(width * height, vp);
+
+    chunks.resize((photons_per_pass + photon_chunk - 1) / photon_chunk);
+}
+
+render_stats sppm_integrator::pass(thread_pool& pool, const sampler& proto)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<thread_context> ctx(pool.size());
+    for(int i = 0; i < pool.size(); ++i)
+    {
+        ctx[i].id = i;
+        ctx[i].smp = proto.clone();
+    }
+
+    pool.parallel_for(height, [&](int i, int id) {
+        for(int j = 0; j < width; ++j)
+            camera_pass(i, j, ctx[id]);
+    });
+
+    // photon k of the pass takes the sampler stream of pixel (height + k / width, k % width)
+    pool.parallel_for(chunks.size(), [&](int c, int id) {
+        chunks[c].clear();
+        int end = std::min(photons_per_pass, (c + 1) * photon_chunk);
+        for(int k = c * photon_chunk; k < end; ++k)
+        {
+            ctx[id].smp->start_pixel_sample(height + k / width, k % width, npass);
+            trace_photon(chunks[c], ctx[id]);
+        }
+    });
+
+    std::vector<photon> all;
+    for(const auto& chunk : chunks)
+        all.insert(all.end(), chunk.begin(), chunk.end());
+    photons.build(std::move(all), &pool);
+
+    pool.parallel_for(height, [&](int i, int /*id*/) {
+        for(int j = 0; j < width; ++j)
+            gather(points[i * width + j]);
+    });
+    npass++;
+
+    render_stats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for(const auto& c : ctx)
+    {
+        stats.rays += c.rays;
+        stats.samples += c.samples;
+    }
+    return stats;
+}
+
+void sppm_integrator::output(FrameBuffer& fb) const
+{
+    double emitted = (double)npass * photons_per_pass;
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+        {
+            const visible_point& vp = points[i * width + j];
+            color L = vp.Ld / std::max(npass, 1);
+            if(emitted > 0)
+                L = L + vp.tau / (emitted * PI * vp.radius * vp.radius);
+            fb.set_pixel(i, j, L);
+        }
+}
+
+render_stats sppm_integrator::render(FrameBuffer& fb, thread_pool& pool, int passes, const sampler& proto)
+{
+    begin(fb.get_width(), fb.get_height());
+
+    render_stats stats;
+    for(int k = 0; k < passes; ++k)
+    {
+        render_stats s = pass(pool, proto);
+        stats.seconds += s.seconds;
+        stats.rays += s.rays;
+        stats.samples += s.samples;
+    }
+
+    output(fb);
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include "math/ray.hpp"
+#include "camera/framebuffer.hpp"
+#include "material/material.hpp"
+#include "pdf/pdf.hpp"
+#include "scene/scene.hpp"
+#include "parallel/tile.hpp"
+#include "parallel/perf_counter.hpp"
+
+// rays in SoA layout
+class ray_queue
+{
+public:
+    std::vector<double> ox, oy, oz;
+    std::vector<double> dx, dy, dz;
+
+    void resize(int n);
+    inline ray get(int i) const { return ray(point(ox[i], oy[i], oz[i]), direction(dx[i], dy[i], dz[i])); }
+    inline void set(int i, const ray& r)
+    {
+        point o = r.get_ori(); direction d = r.get_dir();
+        ox[i] = o.x, oy[i] = o.y, oz[i] = o.z;
+        dx[i] = d.x, dy[i] = d.y, dz[i] = d.z;
+    }
+};
+
+// colors in SoA layout
+class color_queue
+{
+public:
+    std::vector<double> r, g, b;
+
+    void resize(int n);
+    inline color get(int i) const { return color(r[i], g[i], b[i]); }
+    inline void set(int i, const color& c) { r[i] = c.x, g[i] = c.y, b[i] = c.z; }
+};
+
+// how scattered the work of the intersect and shade stages was
+class coherence_stats
+{
+public:
+    long long traced, shaded;
+    long long octant_switches;      // consecutive traced rays with different direction octants
+    long long material_switches;    // consecutive shaded hits with different materials
+    long long batches;              // shading batches launched
+    uint64_t cache_misses;          // during intersect and shade, 0 without a valid perf_counter
+
+    coherence_stats() : traced(0), shaded(0), octant_switches(0), material_switches(0), batches(0), cache_misses(0) {}
+
+    void show() const;
+};
+
+/*
+    streaming version of MC_PT, the same estimator evaluated stage by stage over a fixed set of path slots
+        regenerate: finished paths are added to their pixel, free slots take the next (pixel, sample)
+        camera:     primary rays of the new paths
+        intersect:  closest hit of every live path
+        shade:      emission, light sample (queued as a shadow ray), BRDF sample, russian roulette
+        shadow:     visibility of the queued light samples
+    before intersect the live paths can be sorted by direction octant and origin Morton code,
+    before shade by material, which is then shaded one contiguous batch per material
+    the order only changes which path runs when, so the image is the same either way, and for any
+    thread count at a given number of slots
+    every stage but regenerate runs over the pool in chunks
+    a path re-seeds the sampler from its (pixel, sample, dimension), so it draws the same numbers as MC_PT
+*/
+class wavefront_integrator
+{
+private:
+    const scene& sc;
+    int max_depth;
+    int queue_size;         // 0: default_slots
+
+    static const int chunk = 1024;
+    // not scaled by the thread count, when a path ends and so the order of the adds into a pixel
+    // depends on the number of slots
+    static const int default_slots = 65536;
+
+    // path state
+    std::vector<int> pixel, sample, depth, dim;
+    std::vector<char> alive, specular;
+    color_queue beta, L;
+    ray_queue rays;
+
+    // closest hits
+    std::vector<hit_record> hits;
+    std::vector<char> hit;
+
+    // light samples waiting for a visibility test
+    ray_queue shadow_rays;
+    color_queue shadow_beta;
+    std::vector<double> shadow_pdf;
+    std::vector<char> shadow;
+
+    std::vector<int> active;
+
+    // reordering
+    bool sort_rays, sort_hits;
+    AABB bounds;
+    static const int cell_bits = 9;     // 8^3 Morton cells per direction octant
+    std::vector<uint32_t> keys;
+    std::vector<int> order, bins;
+    coherence_stats coherence;
+    perf_counter* counter;
+
+    template <class F>
+    void for_each(thread_pool& pool, std::vector<thread_context>& ctx, const int* items, int n, F&& f);
+
+    uint32_t ray_key(int k) const;
+    void sort_active();
+
+    void resize(int n);
+
+    void camera_stage(int k, int width, int height, thread_context& ctx);
+    void intersect_stage(int k, thread_context& ctx);
+    void shade_stage(int k, int width, thread_context& ctx);
+    void shadow_stage(int k, thread_context& ctx);
+
+public:
+    wavefront_integrator(const scene& _sc, int _max_depth, int _queue_size = 0);
+
+    inline void set_reorder(bool _rays, bool _hits) { sort_rays = _rays, sort_hits = _hits; }
+    inline void set_counter(perf_counter* _c) { counter = _c; }
+    inline const coherence_stats& get_coherence() const { return coherence; }
+
+    render_stats render(FrameBuffer& fb, thread_pool& pool, int sample_per_pixel, const sampler& proto = independent_sampler());
+};
+
+#include "wavefront.inl"
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "wavefront.hpp"
+
+void ray_queue::resize(int n)
+{
+    ox.resize(n); oy.resize(n); oz.resize(n);
+    dx.resize(n); dy.resize(n); dz.resize(n);
+}
+
+void color_queue::resize(int n)
+{
+    r.resize(n); g.resize(n); b.resize(n);
+}
+
+void coherence_stats::show() const
+{
+    printf("traced %lld, octant switches %lld (%.3f), shaded %lld, material switches %lld (%.3f), batches %lld, cache misses %llu\n",
+        traced, octant_switches, traced ? (double)octant_switches / traced : 0.0,
+        shaded, material_switches, shaded ? (double)material_switches / shaded : 0.0,
+        batches, (unsigned long long)cache_misses);
+}
+
+wavefront_integrator::wavefront_integrator(const scene& _sc, int _max_depth, int _queue_size)
+    : sc(_sc), max_depth(_max_depth), queue_size(_queue_size), sort_rays(true), sort_hits(true), counter(nullptr) {}
+
+void wavefront_integrator::resize(int n)
+{
+    pixel.resize(n); sample.resize(n);
+    depth.resize(n); dim.resize(n);
+    alive.resize(n); specular.resize(n);
+    beta.resize(n); L.resize(n);
+    rays.resize(n);
+
+    hits.resize(n); hit.resize(n);
+
+    shadow_rays.resize(n); shadow_beta.resize(n);
+    shadow_pdf.resize(n); shadow.resize(n);
+
+    active.reserve(n);
+    keys.reserve(n);
+    order.reserve(n);
+}
+
+template <class F>
+void wavefront_integrator::for_each(thread_pool& pool, std::vector<thread_context>& ctx, const int* items, int n, F&& f)
+{
+    pool.parallel_for((n + chunk - 1) / chunk, [&](int c, int id) {
+        int end = std::min(n, (c + 1) * chunk);
+        for(int i = c * chunk; i < end; ++i)
+            f(items[i], ctx[id]);
+    });
+}
+
+// direction octant above a 30-bit Morton code of the origin inside the scene bounds
+uint32_t wavefront_integrator::ray_key(int k) const
+{
+    uint32_t octant = (rays.dx[k] < 0) << 2 | (rays.dy[k] < 0) << 1 | (rays.dz[k] < 0);
+
+    auto cell = [](double x, double lo, double hi) {
+        double t = (x - lo) / (hi - lo);
+        return (uint32_t)myclamp(t * 1024.0, 0.0, 1023.0);
+    };
+    uint32_t code = morton_3d(cell(rays.ox[k], bounds.minimum.x, bounds.maximum.x),
+                              cell(rays.oy[k], bounds.minimum.y, bounds.maximum.y),
+                              cell(rays.oz[k], bounds.minimum.z, bounds.maximum.z));
+    return octant << 30 | code;
+}
+
+/*
+    counting sort of the live paths into octant x coarse Morton cells, ties keep their slot order
+    a cell holds a few paths, finer keys cost more to sort than they save in traversal
+*/
+void wavefront_integrator::sort_active()
+{
+    const int shift = 30 - cell_bits;
+    bins.assign((8 << cell_bits) + 1, 0);
+
+    keys.clear();
+    for(int k : active)
+    {
+        uint32_t key = ray_key(k);
+        uint32_t bin = (key >> 30) << cell_bits | (key & ((1u << 30) - 1)) >> shift;
+        keys.push_back(bin);
+        bins[bin + 1]++;
+    }
+    for(size_t b = 1; b < bins.size(); ++b)
+        bins[b] += bins[b - 1];
+
+    order.resize(active.size());
+    for(size_t i = 0; i < active.size(); ++i)
+        order[bins[keys[i]]++] = active[i];
+    active.swap(order);
+}
+
+void wavefront_integrator::camera_stage(int k, int width, int height, thread_context& ctx)
+{
+    int row = pixel[k] / width, col = pixel[k] % width;
+
+    sampler& smp = *ctx.smp;
+    smp.start_pixel_sample(row, col, sample[k]);
+
+    coord jitter = smp.get_2d();
+    double u = (row + jitter.x) / height;
+    double v = (col + jitter.y) / width;
+    rays.set(k, sc.camera.get_ray(v, u));
+
+    dim[k] = smp.get_dimension();
+    depth[k] = 0;
+    alive[k] = 1;
+    specular[k] = 1;
+    beta.set(k, color(1.0));
+    L.set(k, color(0.0));
+}
+
+void wavefront_integrator::intersect_stage(int k, thread_context& ctx)
+{
+    ctx.rays++;
+    hit[k] = sc.world.hit(rays.get(k), hits[k]);
+}
+
+void wavefront_integrator::shade_stage(int k, int width, thread_context& ctx)
+{
+    shadow[k] = 0;
+    if(!hit[k])
+    {
+        if(specular[k])
+            L.set(k, L.get(k) + beta.get(k) * sc.lights->environment(rays.get(k).get_dir()));
+        alive[k] = 0;
+        return;
+    }
+
+    sampler& smp = *ctx.smp;
+    smp.start_pixel_sample(pixel[k] / width, pixel[k] % width, sample[k]);
+    smp.set_dimension(dim[k]);
+
+    const hit_record& rec = hits[k];
+    ray r = rays.get(k);
+    color b = beta.get(k);
+
+    // sampled direction from the last vertex is from a specular BRDF, add emitted term
+    if(specular[k])
+        L.set(k, L.get(k) + b * rec.hit_mat->emitted(rec.uv));
+
+    scatter_record srec;
+    if(!rec.hit_mat->scatter(r, rec, srec, smp))
+    {
+        alive[k] = 0;
+        return;
+    }
+
+    if(srec.is_specular)
+    {
+        beta.set(k, b * srec.attenuation);
+        rays.set(k, srec.specular_ray);
+        specular[k] = 1;
+    }
+    else
+    {
+        // sample light, traced later in the shadow stage
+        geometry_pdf gp(rec.p, sc.lights);
+        direction out = gp.generate(smp);
+        ray light_ray(rec.p, out);
+
+        shadow_rays.set(k, light_ray);
+        shadow_pdf[k] = gp.value(out);
+        shadow_beta.set(k, b * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, light_ray));
+        shadow[k] = 1;
+
+        // sample brdf
+        direction o = srec.brdf_pdf.generate(smp);
+        double pv = srec.brdf_pdf.value(o);
+        ray scattered(rec.p, o);
+
+        b = b * srec.attenuation * rec.hit_mat->brdf_cos(r, rec, scattered) / pv;
+        rays.set(k, scattered);
+        specular[k] = 0;
+
+        if(depth[k] > 3)
+        {
+            double RR = 0.05 > 1 - b.y ? 0.05 : 1 - b.y;
+            if(smp.get_1d() < RR)
+                alive[k] = 0;
+            b = b / (1 - RR);
+        }
+        beta.set(k, b);
+    }
+
+    if(++depth[k] >= max_depth)
+        alive[k] = 0;
+    dim[k] = smp.get_dimension();
+}
+
+void wavefront_integrator::shadow_stage(int k, thread_context& ctx)
+{
+    ray light_ray = shadow_rays.get(k);
+
+    hit_record l_rec1, l_rec2;
+    ctx.rays++;
+    if(sc.world.hit(light_ray, l_rec1))
+    {
+        if(sc.lights->hit(light_ray, l_rec2) && (l_rec1.p - l_rec2.p).length_square() < EPS)
+            L.set(k, L.get(k) + shadow_beta.get(k) * l_rec1.hit_mat->emitted(l_rec1.uv) / shadow_pdf[k]);
+    }
+    else if(shadow_pdf[k] > 0)
+        L.set(k, L.get(k) + shadow_beta.get(k) * sc.lights->environment(light_ray.get_dir()) / shadow_pdf[k]);
+}
+
+render_stats wavefront_integrator::render(FrameBuffer& fb, thread_pool& pool, int sample_per_pixel, const sampler& proto)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const int width = fb.get_width(), height = fb.get_height();
+    const long long npixel = (long long)width * height;
+    const long long total = npixel * sample_per_pixel;
+    const int slots = queue_size > 0 ? queue_size : default_slots;
+    resize(slots);
+
+    bounds = sc.world.bounding_box();
+    coherence = coherence_stats();
+    uint64_t misses = counter ? counter->read() : 0;
+
+    std::vector<thread_context> ctx(pool.size());
+    for(int i = 0; i < pool.size(); ++i)
+    {
+        ctx[i].id = i;
+        ctx[i].smp = proto.clone();
+    }
+
+    std::vector<color> accum(npixel, color(0.0));
+    std::fill(pixel.begin(), pixel.end(), -1);
+    std::fill(alive.begin(), alive.end(), 0);
+
+    std::vector<int> new_paths, shadow_list;
+    new_paths.reserve(slots);
+    shadow_list.reserve(slots);
+
+    long long next = 0;     // work item = sample * npixel + pixel
+    while(true)
+    {
+        // regenerate, serial so pixels accumulate in slot order, which the thread count does not change
+        new_paths.clear();
+        for(int k = 0; k < slots; ++k)
+        {
+            if(pixel[k] >= 0 && !alive[k])
+            {
+                accum[pixel[k]] = accum[pixel[k]] + L.get(k);
+                pixel[k] = -1;
+            }
+            if(pixel[k] < 0 && next < total)
+            {
+                pixel[k] = next % npixel;
+                sample[k] = next / npixel;
+                next++;
+                new_paths.push_back(k);
+            }
+        }
+
+        for_each(pool, ctx, new_paths.data(), new_paths.size(), [&](int k, thread_context& c) { camera_stage(k, width, height, c); });
+
+        active.clear();
+        for(int k = 0; k < slots; ++k)
+            if(pixel[k] >= 0 && alive[k])
+                active.push_back(k);
+        if(active.empty())
+            break;
+
+        if(sort_rays)
+            sort_active();
+
+        int octant = -1;
+        for(int k : active)
+        {
+            int o = (rays.dx[k] < 0) << 2 | (rays.dy[k] < 0) << 1 | (rays.dz[k] < 0);
+            coherence.octant_switches += o != octant;
+            octant = o;
+        }
+        coherence.traced += active.size();
+
+        if(counter) counter->start();
+        for_each(pool, ctx, active.data(), active.size(), [&](int k, thread_context& c) { intersect_stage(k, c); });
+        if(counter) counter->stop();
+
+        // misses go last, shade just retires them
+        auto material_of = [&](int k) { return hit[k] ? hits[k].hit_mat->id() : (int)MAT_COUNT; };
+        if(sort_hits)
+        {
+            // counting sort, stable so a batch stays in traversal order
+            bins.assign(MAT_COUNT + 2, 0);
+            for(int k : active)
+                bins[material_of(k) + 1]++;
+            for(size_t b = 1; b < bins.size(); ++b)
+                bins[b] += bins[b - 1];
+            order.resize(active.size());
+            for(int k : active)
+                order[bins[material_of(k)]++] = k;
+            active.swap(order);
+        }
+
+        int material = -1;
+        for(int k : active)
+        {
+            int m = material_of(k);
+            coherence.material_switches += m != material;
+            material = m;
+        }
+        coherence.shaded += active.size();
+
+        if(counter) counter->start();
+        if(sort_hits)
+        {
+            // one batch per material, every batch a contiguous run of active
+            for(size_t i = 0, j; i < active.size(); i = j)
+            {
+                int m = material_of(active[i]);
+                for(j = i + 1; j < active.size() && material_of(active[j]) == m; ++j);
+                for_each(pool, ctx, active.data() + i, j - i, [&](int k, thread_context& c) { shade_stage(k, width, c); });
+                coherence.batches++;
+            }
+        }
+        else
+        {
+            for_each(pool, ctx, active.data(), active.size(), [&](int k, thread_context& c) { shade_stage(k, width, c); });
+            coherence.batches++;
+        }
+        if(counter) counter->stop();
+
+        shadow_list.clear();
+        for(int k : active)
+            if(shadow[k])
+                shadow_list.push_back(k);
+        for_each(pool, ctx, shadow_list.data(), shadow_list.size(), [&](int k, thread_context& c) { shadow_stage(k, c); });
+    }
+
+    for(int i = 0; i < height; ++i)
+        for(int j = 0; j < width; ++j)
+            fb.set_pixel(i, j, accum[i * width + j] / sample_per_pixel);
+
+    render_stats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.samples = total;
+    for(const auto& c : ctx)
+        stats.rays += c.rays;
+    if(counter)
+        coherence.cache_misses = counter->read() - misses;
+    return stats;
+}
\ No newline at end of file
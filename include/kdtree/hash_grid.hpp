@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "kdTree.hpp"
+
+/*
+    uniform grid over payloads of type T, hashed into a table of about one bucket per item
+    cells are as wide as the query radius, so a range query visits at most 3 x 3 x 3 cells
+
+    the build is a counting sort by bucket: keys and per-chunk histograms in parallel, a prefix
+    sum, then every chunk scatters its items to its own offsets, so a bucket is a contiguous,
+    stable run of the item array whatever the thread count
+    every item keeps its packed cell so colliding cells of a bucket are skipped before the distance
+*/
+template <class T>
+class hash_grid
+{
+private:
+    double cell;
+    point lo;
+    uint32_t mask;
+
+    std::vector<T> items;
+    std::vector<uint64_t> cells;        // packed cell of every item
+    std::vector<int> start;             // bucket b holds items [start[b], start[b + 1])
+
+    static const int cell_bits = 21;
+
+    inline int coord(double x, double x0) const { return (int)floor(myclamp((x - x0) / cell, -1.0, (double)(1 << cell_bits))); }
+    static inline uint64_t pack(int x, int y, int z) { return (uint64_t)x << (2 * cell_bits) | (uint64_t)y << cell_bits | (uint64_t)z; }
+    inline uint32_t bucket(uint64_t c) const { return (uint32_t)(mix_bits(c) & mask); }
+
+public:
+    hash_grid() : cell(1.0), mask(0) {}
+    hash_grid(std::vector<T> data, double radius, thread_pool* pool = nullptr) { build(std::move(data), radius, pool); }
+
+    void build(std::vector<T> data, double radius, thread_pool* pool = nullptr);
+
+    inline int size() const { return items.size(); }
+    inline double cell_size() const { return cell; }
+    inline const T& operator[](int i) const { return items[i]; }
+
+    // f(const T&, distance squared) for every payload within r of q, any r, 27 cells when r <= cell_size()
+    template <class F>
+    void range(const point& q, double r, F&& f) const;
+
+    // indices of the payloads within r of q, at most capacity written, returns how many there are
+    int range(const point& q, double r, int* out, int capacity) const;
+};
+
+#include "hash_grid.inl"
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "hash_grid.hpp"
+
+template <class T>
+void hash_grid<T>::build(std::vector<T> data, double radius, thread_pool* pool)
+{
+    const int n = data.size();
+
+    lo = point(INF, INF, INF);
+    point hi(-INF, -INF, -INF);
+    for(const T& t : data)
+    {
+        const point& p = kd_position(t);
+        lo = point(fmin(lo.x, p.x), fmin(lo.y, p.y), fmin(lo.z, p.z));
+        hi = point(fmax(hi.x, p.x), fmax(hi.y, p.y), fmax(hi.z, p.z));
+    }
+    direction extent = n > 0 ? hi - lo : direction(0, 0, 0);
+
+    // wide enough that every coordinate fits its bits
+    double limit = (1 << cell_bits) - 2;
+    cell = fmax(radius, fmax(extent.x, fmax(extent.y, extent.z)) / limit);
+    if(cell <= 0)
+        cell = 1.0;
+
+    uint32_t nbucket = 1;
+    while(nbucket < (uint32_t)n)
+        nbucket <<= 1;
+    mask = nbucket - 1;
+
+    // one chunk per thread, each with its own histogram
+    const int nchunk = pool && n > 4096 ? pool->size() : 1;
+    const int chunk = (n + nchunk - 1) / std::max(nchunk, 1);
+    auto run = [&](int count, const std::function<void(int)>& f) {
+        if(nchunk > 1)
+            pool->parallel_for(count, [&](int c, int) { f(c); });
+        else
+            for(int c = 0; c < count; ++c)
+                f(c);
+    };
+
+    std::vector<uint64_t> keys(n);
+    std::vector<int> hist((size_t)nchunk * nbucket, 0);
+    run(nchunk, [&](int c) {
+        int* h = &hist[(size_t)c * nbucket];
+        for(int i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i)
+        {
+            const point& p = kd_position(data[i]);
+            keys[i] = pack(coord(p.x, lo.x), coord(p.y, lo.y), coord(p.z, lo.z));
+            h[bucket(keys[i])]++;
+        }
+    });
+
+    // exclusive prefix over (bucket, chunk), the histograms become scatter offsets
+    start.assign(nbucket + 1, 0);
+    int sum = 0;
+    for(uint32_t b = 0; b < nbucket; ++b)
+    {
+        start[b] = sum;
+        for(int c = 0; c < nchunk; ++c)
+        {
+            int& h = hist[(size_t)c * nbucket + b];
+            int cnt = h;
+            h = sum;
+            sum += cnt;
+        }
+    }
+    start[nbucket] = sum;
+
+    items.resize(n);
+    cells.resize(n);
+    run(nchunk, [&](int c) {
+        int* h = &hist[(size_t)c * nbucket];
+        for(int i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i)
+        {
+            int k = h[bucket(keys[i])]++;
+            items[k] = data[i];
+            cells[k] = keys[i];
+        }
+    });
+}
+
+template <class T>
+template <class F>
+void hash_grid<T>::range(const point& q, double r, F&& f) const
+{
+    if(items.empty())
+        return;
+
+    const double r2 = r * r;
+    const int hi = (1 << cell_bits) - 1;
+    int x0 = std::max(0, coord(q.x - r, lo.x)), x1 = std::min(hi, coord(q.x + r, lo.x));
+    int y0 = std::max(0, coord(q.y - r, lo.y)), y1 = std::min(hi, coord(q.y + r, lo.y));
+    int z0 = std::max(0, coord(q.z - r, lo.z)), z1 = std::min(hi, coord(q.z + r, lo.z));
+
+    // squared distance from q to the slab of cell i along one axis
+    auto gap = [&](double v, double v0, int i) {
+        double a = v0 + i * cell, b = a + cell;
+        double d = v < a ? a - v : (v > b ? v - b : 0.0);
+        return d * d;
+    };
+
+    for(int x = x0; x <= x1; ++x)
+    {
+        double dx = gap(q.x, lo.x, x);
+        for(int y = y0; y <= y1; ++y)
+        {
+            double dxy = dx + gap(q.y, lo.y, y);
+            if(dxy > r2)
+                continue;
+            for(int z = z0; z <= z1; ++z)
+            {
+                // corner and edge cells the sphere misses
+                if(dxy + gap(q.z, lo.z, z) > r2)
+                    continue;
+
+                uint64_t c = pack(x, y, z);
+                uint32_t b = bucket(c);
+                for(int k = start[b]; k < start[b + 1]; ++k)
+                {
+                    if(cells[k] != c)
+                        continue;
+                    double d2 = (kd_position(items[k]) - q).length_square();
+                    if(d2 <= r2)
+                        f(items[k], d2);
+                }
+            }
+        }
+    }
+}
+
+template <class T>
+int hash_grid<T>::range(const point& q, double r, int* out, int capacity) const
+{
+    int count = 0;
+    const T* base = items.data();
+    range(q, r, [&](const T& t, double) {
+        if(count < capacity)
+            out[count] = &t - base;
+        count++;
+    });
+    return count;
+}
\ No newline at end of file
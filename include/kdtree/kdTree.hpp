@@ -1,45 +1,77 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 #include "math/utility.hpp"
-#include "gmm/gmm.hpp"
-#include <queue>
+#include "parallel/threadpool.hpp"
 
-class knncmp
+// position of a payload, overload it next to any payload type stored in a kdTree
+inline const point& kd_position(const point& p) { return p; }
+
+inline double axis_value(const point& p, AXIS a)
+{
+    return a == AXIS::AXIS_X ? p.x : (a == AXIS::AXIS_Y ? p.y : p.z);
+}
+
+class kd_neighbor
 {
-    point p;
 public:
-    knncmp(const point& _p) : p(_p) {}
-    bool operator()(const point& a, const point& b)
-    {
-        return (a - p).length_square() < (b - p).length_square();
-    }
+    int index;          // into the tree, see operator[]
+    double dist2;
 };
 
+/*
+    static balanced kd-tree over payloads of type T, stored as an implicit array in heap order
+    node i has children 2i + 1 and 2i + 2 and the tree is left-balanced (complete), so there are
+    no pointers, no per-node allocation and a subtree is a contiguous run of each level
 
+    the build runs level by level, every node of a level places its median with nth_element on the
+    axis of widest extent, the nodes of a level are independent and spread over the pool
+    queries walk an explicit stack and write to caller buffers, they never allocate
+*/
+template <class T>
 class kdTree
 {
 private:
-    point p;    
+    std::vector<T> nodes;
+    std::vector<uint8_t> axes;          // split axis of every node
 
-    AXIS axis;
-    int cnt;
-    kdTree *left, *right;    
-    kdTree *parent;
+    static const int max_stack = 64;
 
-    void childset(std::vector<point>& out);
-    void _knn(int k, const point& _p, std::priority_queue<point, std::vector<point>, knncmp>& pq) const;
+    // size of the left subtree of a complete binary tree with n nodes
+    static int left_size(int n);
 
 public:
-    kdTree() : parent(nullptr) {}
-    kdTree(const point& _p, AXIS _a) : p(_p), axis(_a), cnt(1), left(nullptr), right(nullptr), parent(nullptr) {}
-    kdTree(std::vector<point>& data) : kdTree(data, 0, data.size(), (AXIS)random_int(0, 2)) {}
-    kdTree(std::vector<point>& data, int start, int end, AXIS _a);
-    
-    ~kdTree();
-
-    void rebuild(const std::vector<point>& data);
-    void insert(const point& _p);
-    std::vector<point> knn(int k, const point& _p) const;
+    kdTree() {}
+    kdTree(std::vector<T> data, thread_pool* pool = nullptr) { build(std::move(data), pool); }
+
+    void build(std::vector<T> data, thread_pool* pool = nullptr);
+
+    // a built tree as operator[] and axis() list it, kept as is, false when it cannot be one
+    bool assign(std::vector<T> _nodes, std::vector<uint8_t> _axes);
+
+    inline int size() const { return nodes.size(); }
+    inline bool empty() const { return nodes.empty(); }
+    inline const T& operator[](int i) const { return nodes[i]; }
+    inline int axis(int i) const { return axes[i]; }
+
+    /*
+        visit(i, distance squared) for every node that can still be nearer than bound(), the
+        squared search radius, which may shrink as visit is called
+    */
+    template <class V, class B>
+    void nearest(const point& q, V&& visit, B&& bound) const;
+
+    // the k nearest payloads of q written to out, nearest first, returns how many (<= k)
+    int knn(const point& q, int k, kd_neighbor* out) const;
+
+    // f(const T&, distance squared) for every payload within r of q
+    template <class F>
+    void range(const point& q, double r, F&& f) const;
+
+    // indices of the payloads within r of q, at most capacity written, returns how many there are
+    int range(const point& q, double r, int* out, int capacity) const;
 };
 
 #include "kdTree.inl"
\ No newline at end of file
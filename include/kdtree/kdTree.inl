@@ -1,167 +1,194 @@
 #include "kdTree.hpp"
 
-bool point_cmp_x(const point& _a, const point& _b)
+template <class T>
+int kdTree<T>::left_size(int n)
 {
-    return _a.x < _b.x;
+    if(n <= 1)
+        return 0;
+
+    int h = 0;
+    while((2 << h) <= n)
+        h++;
+    int full = (1 << h) - 1;            // nodes above the last level
+    int half = 1 << (h - 1);            // last-level slots under the left child
+    return (half - 1) + std::min(n - full, half);
 }
 
-bool point_cmp_y(const point& _a, const point& _b)
+template <class T>
+void kdTree<T>::build(std::vector<T> data, thread_pool* pool)
 {
-    return _a.y < _b.y;
-}
+    const int n = data.size();
+    nodes.resize(n);
+    axes.resize(n);
 
-bool point_cmp_z(const point& _a, const point& _b)
-{
-    return _a.z < _b.z;
-}
+    // [first[i], last[i]) of data holds the subtree of node i
+    std::vector<int> first(n), last(n);
+    if(n > 0)
+        first[0] = 0, last[0] = n;
 
-// [start, end)
-kdTree::kdTree(std::vector<point>& data, int start, int end, AXIS _a) : axis(_a), cnt(end - start), parent(nullptr)
-{
-    if(end - start == 1)
+    auto place = [&](int i) {
+        int s = first[i], e = last[i];
+
+        point lo(INF, INF, INF), hi(-INF, -INF, -INF);
+        for(int k = s; k < e; ++k)
+        {
+            const point& p = kd_position(data[k]);
+            lo = point(fmin(lo.x, p.x), fmin(lo.y, p.y), fmin(lo.z, p.z));
+            hi = point(fmax(hi.x, p.x), fmax(hi.y, p.y), fmax(hi.z, p.z));
+        }
+        direction extent = hi - lo;
+        AXIS a = (extent.x >= extent.y && extent.x >= extent.z) ? AXIS::AXIS_X
+               : (extent.y >= extent.z)                         ? AXIS::AXIS_Y
+                                                                : AXIS::AXIS_Z;
+
+        int mid = s + left_size(e - s);
+        std::nth_element(data.begin() + s, data.begin() + mid, data.begin() + e, [a](const T& x, const T& y) {
+            return axis_value(kd_position(x), a) < axis_value(kd_position(y), a);
+        });
+
+        nodes[i] = data[mid];
+        axes[i] = (uint8_t)a;
+        if(2 * i + 1 < n) first[2 * i + 1] = s, last[2 * i + 1] = mid;
+        if(2 * i + 2 < n) first[2 * i + 2] = mid + 1, last[2 * i + 2] = e;
+    };
+
+    const int grain = 64;       // nodes per task on the lower levels
+    for(int level_begin = 0; level_begin < n; level_begin = 2 * level_begin + 1)
     {
-        p = data[start];
-        left = right = nullptr;
-        return;
+        int level_end = std::min(n, 2 * level_begin + 1);
+        int count = level_end - level_begin;
+        if(pool && pool->size() > 1 && count > 1)
+            pool->parallel_for((count + grain - 1) / grain, [&](int t, int) {
+                int end = std::min(level_end, level_begin + (t + 1) * grain);
+                for(int i = level_begin + t * grain; i < end; ++i)
+                    place(i);
+            });
+        else
+            for(int i = level_begin; i < level_end; ++i)
+                place(i);
     }
-
-    auto cmp = (_a == AXIS::AXIS_X) ? point_cmp_x
-             : (_a == AXIS::AXIS_Y) ? point_cmp_y
-                                    : point_cmp_z;
-    
-    std::sort(data.begin() + start, data.begin() + end, cmp);
-
-    int mid = (start + end) / 2;
-    
-    p = data[mid];
-    left = right = nullptr;
-    if(mid > start) left = new kdTree(data, start, mid, next_axis(_a));
-    if(end > mid + 1) right = new kdTree(data, mid + 1, end, next_axis(_a));
-
-    if(left) left->parent = this;
-    if(right) right->parent = this;
 }
 
-kdTree::~kdTree()
+template <class T>
+bool kdTree<T>::assign(std::vector<T> _nodes, std::vector<uint8_t> _axes)
 {
-    if(left) delete left;
-    if(right) delete right;
+    if(_nodes.size() != _axes.size())
+        return false;
+    for(uint8_t a : _axes)
+        if(a > 2)
+            return false;
+
+    nodes = std::move(_nodes);
+    axes = std::move(_axes);
+    return true;
 }
 
-void kdTree::childset(std::vector<point>& out)
+template <class T>
+template <class V, class B>
+void kdTree<T>::nearest(const point& q, V&& visit, B&& bound) const
 {
-    out.push_back(p);
-    if(left) left->childset(out);
-    if(right) right->childset(out);
-}
-
-void kdTree::_knn(int k, const point& _p, std::priority_queue<point, std::vector<point>, knncmp>& pq) const
-{
-    bool lt = (axis == AXIS::AXIS_X) ? (_p.x < p.x)
-            : (axis == AXIS::AXIS_Y) ? (_p.y < p.y)
-                                     : (_p.z < p.z);
+    const int n = nodes.size();
 
-    kdTree* node = lt ? left : right;
-    if(node) node->_knn(k, _p, pq);
+    // (node, squared distance to its parent's splitting plane, a lower bound for the whole subtree)
+    int stack[max_stack];
+    double lower[max_stack];
+    int sp = 0;
+    if(n > 0)
+        stack[sp] = 0, lower[sp] = 0.0, sp++;
 
-    pq.push(p);
-    if(pq.size() > k) pq.pop();
-
-    node = lt ? right : left;
-    if(node)
+    while(sp > 0)
     {
-        double dis = (axis == AXIS::AXIS_X) ? fabs(_p.x - p.x)
-                   : (axis == AXIS::AXIS_Y) ? fabs(_p.y - p.y)
-                                            : fabs(_p.z - p.z);
-
-        point t = pq.top();
-        if((t - _p).length_square() > dis * dis)
-            node->_knn(k, _p, pq);
+        sp--;
+        int i = stack[sp];
+        if(lower[sp] > bound())
+            continue;
+
+        const point& p = kd_position(nodes[i]);
+        visit(i, (p - q).length_square());
+
+        AXIS a = (AXIS)axes[i];
+        double delta = axis_value(q, a) - axis_value(p, a);
+        int near = delta < 0 ? 2 * i + 1 : 2 * i + 2;
+        int far = delta < 0 ? 2 * i + 2 : 2 * i + 1;
+
+        // far first so the near side is popped next
+        if(far < n)
+            stack[sp] = far, lower[sp] = delta * delta, sp++;
+        if(near < n)
+            stack[sp] = near, lower[sp] = 0.0, sp++;
     }
 }
 
-void kdTree::rebuild(const std::vector<point>& data)
+template <class T>
+int kdTree<T>::knn(const point& q, int k, kd_neighbor* out) const
 {
-    std::vector<point> t;
-    childset(t);
-    t.insert(t.end(), data.begin(), data.end());
+    if(k <= 0)
+        return 0;
 
-    if(left) delete left;
-    if(right) delete right;
-
-    *this = kdTree(t);
-}
-
-void kdTree::insert(const point& _p)
-{
-    cnt++;
+    // out[0, count) is a max-heap on distance until the end
+    auto farther = [](const kd_neighbor& a, const kd_neighbor& b) { return a.dist2 < b.dist2; };
+    int count = 0;
 
-    bool lt = (axis == AXIS::AXIS_X) ? (_p.x < p.x)
-            : (axis == AXIS::AXIS_Y) ? (_p.y < p.y)
-                                     : (_p.z < p.z);
-    
-    int ln = left ? left->cnt : 0;
-    int rn = right ? right->cnt : 0;
-
-    double prop = (double) (lt ? ln + 1 : ln) / (ln + rn + 1);
-    if(prop < 0.3 || prop > 0.7)
-    {
-        std::vector<point> childs { _p };
-        childset(childs);
-
-        auto cmp = (axis == AXIS::AXIS_X) ? point_cmp_x
-                 : (axis == AXIS::AXIS_Y) ? point_cmp_y
-                                          : point_cmp_z;
-
-        std::sort(childs.begin(), childs.end(), cmp);
-
-        int n = childs.size();
-        int mid = n / 2;
-        
-        p = childs[mid];
-
-        if(left) delete left;
-        if(right) delete right;
-
-        if(mid > 0) left = new kdTree(childs, 0, mid, next_axis(axis));
-        if(n > mid + 1) right = new kdTree(childs, mid + 1, n, next_axis(axis));
-
-        if(left) left->parent = this;
-        if(right) right->parent = this;
-    }
-    else
-    {
-        kdTree* node = lt ? left : right;
-        if(node) node->insert(_p);
-        else
+    nearest(q, [&](int i, double d2) {
+        if(count < k)
         {
-            if(lt) 
-            {
-                left = new kdTree(_p, next_axis(axis));
-                left->parent = this;
-            }
-            else
-            {
-                right = new kdTree(_p, next_axis(axis));
-                right->parent = this;
-            }
+            out[count++] = kd_neighbor { i, d2 };
+            std::push_heap(out, out + count, farther);
         }
-    }
+        else if(d2 < out[0].dist2)
+        {
+            std::pop_heap(out, out + count, farther);
+            out[count - 1] = kd_neighbor { i, d2 };
+            std::push_heap(out, out + count, farther);
+        }
+    }, [&] { return count < k ? INF : out[0].dist2; });
+
+    std::sort_heap(out, out + count, farther);
+    return count;
 }
 
-std::vector<point> kdTree::knn(int k, const point& _p) const
+template <class T>
+template <class F>
+void kdTree<T>::range(const point& q, double r, F&& f) const
 {
-    knncmp mycmp(_p);
-    std::priority_queue<point, std::vector<point>, knncmp> pq(mycmp);
+    const int n = nodes.size();
+    const double r2 = r * r;
 
-    _knn(k, _p, pq);
+    int stack[max_stack];
+    int sp = 0;
+    if(n > 0)
+        stack[sp++] = 0;
 
-    std::vector<point> out;
-    while(!pq.empty())
+    while(sp > 0)
     {
-        out.push_back(pq.top());
-        pq.pop();
+        int i = stack[--sp];
+        const point& p = kd_position(nodes[i]);
+
+        double d2 = (p - q).length_square();
+        if(d2 <= r2)
+            f(nodes[i], d2);
+
+        AXIS a = (AXIS)axes[i];
+        double delta = axis_value(q, a) - axis_value(p, a);
+        int near = delta < 0 ? 2 * i + 1 : 2 * i + 2;
+        int far = delta < 0 ? 2 * i + 2 : 2 * i + 1;
+
+        if(far < n && delta * delta <= r2)
+            stack[sp++] = far;
+        if(near < n)
+            stack[sp++] = near;
     }
+}
 
-    return out;
+template <class T>
+int kdTree<T>::range(const point& q, double r, int* out, int capacity) const
+{
+    int count = 0;
+    const T* base = nodes.data();
+    range(q, r, [&](const T& t, double) {
+        if(count < capacity)
+            out[count] = &t - base;
+        count++;
+    });
+    return count;
 }
\ No newline at end of file
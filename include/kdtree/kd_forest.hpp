@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "kdTree.hpp"
+
+template <class T>
+class kd_item
+{
+public:
+    const T* item;
+    double dist2;
+};
+
+// an immutable state of a kd_forest, safe to query from any number of threads
+template <class T>
+class kd_snapshot
+{
+public:
+    std::vector<std::shared_ptr<const kdTree<T> > > levels;     // level i is empty or holds base << i items at most
+    long long version;
+    int count;
+
+    kd_snapshot() : version(0), count(0) {}
+
+    inline int size() const { return count; }
+
+    // the k nearest payloads of q over every level, nearest first, returns how many (<= k)
+    int knn(const point& q, int k, kd_item<T>* out) const;
+
+    // f(const T&, distance squared) for every payload within r of q
+    template <class F>
+    void range(const point& q, double r, F&& f) const;
+};
+
+/*
+    kd-tree that grows by batches while it is being read, by the logarithmic method (Bentley-Saxe)
+    the items live in static kdTrees of capacity base << i, an insert merges the batch with the
+    full levels below the first one it fits in and rebuilds only that level, so an item is rebuilt
+    O(log n) times and a single insert never touches the big levels until they overflow
+
+    writers serialize among themselves and build the new level outside any reader's way, then
+    publish a new snapshot that shares every untouched level with the old one through an atomic
+    pointer; a reader owns one of `readers` slots, takes a snapshot by announcing it in its slot
+    (a hazard pointer, Michael 2004) and queries it without a lock for as long as the slot holds
+    it, refresh() reloads only when the version moved
+    a replaced snapshot is retired and freed by a later insert once no slot holds it
+*/
+template <class T>
+class kd_forest
+{
+private:
+    int base;
+    thread_pool* pool;          // for the level builds, must not be the pool running the writers
+
+    std::mutex writer;
+    std::atomic<const kd_snapshot<T>*> current;
+    std::atomic<long long> published;
+    std::atomic<int> count;
+
+    int nreader;
+    std::unique_ptr<std::atomic<const kd_snapshot<T>*>[]> hazards;     // per reader slot
+    std::vector<const kd_snapshot<T>*> retired;                        // under writer
+
+    void reclaim();
+
+public:
+    kd_forest(int _readers, int _base = 256, thread_pool* _pool = nullptr);
+    ~kd_forest();
+
+    kd_forest(const kd_forest&) = delete;
+    kd_forest& operator=(const kd_forest&) = delete;
+
+    void insert(std::vector<T> batch);
+
+    inline long long version() const { return published.load(std::memory_order_acquire); }
+    inline int size() const { return count.load(std::memory_order_acquire); }
+    inline int readers() const { return nreader; }
+
+    // the latest snapshot, valid until the slot takes another one or is released
+    const kd_snapshot<T>* snapshot(int reader);
+    inline void release(int reader) { hazards[reader].store(nullptr, std::memory_order_release); }
+
+    // s keeps its snapshot unless a newer one was published
+    inline void refresh(int reader, const kd_snapshot<T>*& s)
+    {
+        if(!s || s->version != version())
+            s = snapshot(reader);
+    }
+};
+
+#include "kd_forest.inl"
\ No newline at end of file
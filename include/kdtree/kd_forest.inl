@@ -0,0 +1,133 @@
+#include "kd_forest.hpp"
+
+template <class T>
+int kd_snapshot<T>::knn(const point& q, int k, kd_item<T>* out) const
+{
+    if(k <= 0)
+        return 0;
+
+    // one max-heap across the levels, each level prunes with the k-th distance so far
+    auto farther = [](const kd_item<T>& a, const kd_item<T>& b) { return a.dist2 < b.dist2; };
+    int count = 0;
+
+    for(const auto& level : levels)
+    {
+        if(!level)
+            continue;
+        const kdTree<T>& tree = *level;
+        tree.nearest(q, [&](int i, double d2) {
+            if(count < k)
+            {
+                out[count++] = kd_item<T> { &tree[i], d2 };
+                std::push_heap(out, out + count, farther);
+            }
+            else if(d2 < out[0].dist2)
+            {
+                std::pop_heap(out, out + count, farther);
+                out[count - 1] = kd_item<T> { &tree[i], d2 };
+                std::push_heap(out, out + count, farther);
+            }
+        }, [&] { return count < k ? INF : out[0].dist2; });
+    }
+
+    std::sort_heap(out, out + count, farther);
+    return count;
+}
+
+template <class T>
+template <class F>
+void kd_snapshot<T>::range(const point& q, double r, F&& f) const
+{
+    for(const auto& level : levels)
+        if(level)
+            level->range(q, r, f);
+}
+
+template <class T>
+kd_forest<T>::kd_forest(int _readers, int _base, thread_pool* _pool)
+    : base(std::max(1, _base)), pool(_pool), current(new kd_snapshot<T>()), published(0), count(0),
+      nreader(std::max(1, _readers)), hazards(new std::atomic<const kd_snapshot<T>*>[nreader])
+{
+    for(int r = 0; r < nreader; ++r)
+        hazards[r].store(nullptr, std::memory_order_relaxed);
+}
+
+template <class T>
+kd_forest<T>::~kd_forest()
+{
+    for(const kd_snapshot<T>* s : retired)
+        delete s;
+    delete current.load();
+}
+
+template <class T>
+const kd_snapshot<T>* kd_forest<T>::snapshot(int reader)
+{
+    // announce, then check it is still current, a writer retiring it after that sees the slot
+    const kd_snapshot<T>* s = current.load();
+    while(true)
+    {
+        hazards[reader].store(s);
+        const kd_snapshot<T>* now = current.load();
+        if(now == s)
+            return s;
+        s = now;
+    }
+}
+
+template <class T>
+void kd_forest<T>::reclaim()
+{
+    size_t kept = 0;
+    for(const kd_snapshot<T>* s : retired)
+    {
+        bool held = false;
+        for(int r = 0; r < nreader && !held; ++r)
+            held = hazards[r].load() == s;
+        if(held)
+            retired[kept++] = s;
+        else
+            delete s;
+    }
+    retired.resize(kept);
+}
+
+template <class T>
+void kd_forest<T>::insert(std::vector<T> batch)
+{
+    if(batch.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(writer);
+    const kd_snapshot<T>* old = current.load();
+
+    auto next = new kd_snapshot<T>(*old);
+    next->version = old->version + 1;
+    next->count = old->count + batch.size();
+
+    // carry the full levels up until the items fit in an empty one
+    size_t i = 0;
+    for(; ; ++i)
+    {
+        if(i == next->levels.size())
+            next->levels.emplace_back();
+        size_t capacity = (size_t)base << i;
+        if(!next->levels[i] && batch.size() <= capacity)
+            break;
+        if(next->levels[i])
+        {
+            const kdTree<T>& tree = *next->levels[i];
+            for(int k = 0; k < tree.size(); ++k)
+                batch.push_back(tree[k]);
+            next->levels[i].reset();
+        }
+    }
+    next->levels[i] = std::make_shared<const kdTree<T> >(std::move(batch), pool);
+
+    count.store(next->count, std::memory_order_release);
+    current.store(next);
+    published.store(next->version, std::memory_order_release);
+
+    retired.push_back(old);
+    reclaim();
+}
\ No newline at end of file
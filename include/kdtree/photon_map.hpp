@@ -0,0 +1,17 @@
+#pragma once
+
+#include "math/utility.hpp"
+#include "kdTree.hpp"
+
+class photon
+{
+public:
+    point p;
+    direction wi;       // unit, toward where the photon came from
+    color power;        // flux, before dividing by the photons emitted
+};
+
+inline const point& kd_position(const photon& ph) { return ph.p; }
+
+// photons in a balanced kd-tree (Jensen's heap-ordered photon map)
+typedef kdTree<photon> photon_map;
\ No newline at end of file
@@ -10,18 +10,22 @@ public:
     ray specular_ray;
     bool is_specular;
     color attenuation;
-    std::shared_ptr<pdf> brdf_pdf;
+    cosine_pdf brdf_pdf;    // held by value, scattering never allocates
 };
 
 
 
+// material kinds, the key of material-coherent shading batches
+enum material_id { MAT_DIFFUSE, MAT_SPECULAR, MAT_GLOSSY, MAT_DIELECTRIC, MAT_LIGHT, MAT_COUNT };
+
 class material
 {
 private:
 
 public:
+    virtual int id() const = 0;
     virtual color emitted(coord uv) const { return color(0, 0, 0); }
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const = 0;
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const = 0;
     virtual double brdf_cos(const ray& r, const hit_record& rec, const ray& scattered) const { return 0.0; }
 };
 
@@ -37,7 +41,8 @@ public:
     diffuse(const color& _a) : albedo(std::make_shared<solid_color>(_a)) {}
     diffuse(std::shared_ptr<texture> _a) : albedo(_a) {}
 
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const override;
+    virtual int id() const override { return MAT_DIFFUSE; }
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const override;
     virtual double brdf_cos(const ray& r, const hit_record& rec, const ray& scattered) const override;
 };
 
@@ -53,7 +58,8 @@ public:
     specular(const color& _a) : albedo(std::make_shared<solid_color>(_a)) {}
     specular(std::shared_ptr<texture> _a) : albedo(_a) {}
 
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const override;
+    virtual int id() const override { return MAT_SPECULAR; }
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const override;
 };
 
 
@@ -70,7 +76,8 @@ public:
     glossy(const color& _a, double _r) : albedo(std::make_shared<solid_color>(_a)), radius(_r) {}
     glossy(std::shared_ptr<texture> _a, double _r) : albedo(_a), radius(_r) {}
 
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const override;
+    virtual int id() const override { return MAT_GLOSSY; }
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const override;
 };
 
 
@@ -84,7 +91,8 @@ public:
     dielectric() {}
     dielectric(double _i): index(_i) {}
 
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const override;
+    virtual int id() const override { return MAT_DIELECTRIC; }
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const override;
 
 private:
     static double reflectance(double cosine, double _i);      // Schlic Approximation
@@ -102,8 +110,9 @@ public:
     diffuse_light(std::shared_ptr<texture> _e) : emit(_e) {}
     diffuse_light(const color& _e) : emit(std::make_shared<solid_color>(_e)) {}
 
+    virtual int id() const override { return MAT_LIGHT; }
     virtual color emitted(coord uv) const override { return emit->get_color(uv); }
-    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec) const override { return false; }
+    virtual bool scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const override { return false; }
 };
 
 
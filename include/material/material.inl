@@ -1,9 +1,9 @@
 #include "material.hpp"
 
-bool diffuse::scatter(const ray& r, const hit_record& rec, scatter_record& srec) const
+bool diffuse::scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const
 {
     srec.attenuation = albedo->get_color(rec.uv);
-    srec.brdf_pdf = std::make_shared<cosine_pdf>(rec.normal);
+    srec.brdf_pdf = cosine_pdf(rec.normal);
     srec.is_specular = false;
 
     return true;
@@ -16,7 +16,7 @@ double diffuse::brdf_cos(const ray& r, const hit_record& rec, const ray& scatter
     return (cosine <= 0) ? 0 : brdf * cosine;
 }
 
-bool specular::scatter(const ray& r, const hit_record& rec, scatter_record& srec) const
+bool specular::scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const
 {
     direction rdir = r.get_dir();
     direction out = rdir - rec.normal * (dot(rdir, rec.normal) * 2 / rec.normal.length());
@@ -24,15 +24,14 @@ bool specular::scatter(const ray& r, const hit_record& rec, scatter_record& srec
     srec.specular_ray = ray(rec.p, out);
     srec.is_specular = true;
     srec.attenuation = albedo->get_color(rec.uv);
-    srec.brdf_pdf = nullptr;
     return dot(out, rec.normal) > 0;
 }
 
-bool glossy::scatter(const ray& r, const hit_record& rec, scatter_record& srec) const
+bool glossy::scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const
 {
     direction rdir = r.get_dir();
     direction out = rdir - rec.normal * (dot(rdir, rec.normal) * 2 / rec.normal.length());
-    out = out.normalize() + random_sphere() * radius;
+    out = out.normalize() + sample_sphere(s.get_2d(), s.get_1d()) * radius;
 
     if(dot(out, rec.normal) < 0)
         return false;
@@ -40,11 +39,10 @@ bool glossy::scatter(const ray& r, const hit_record& rec, scatter_record& srec)
     srec.specular_ray = ray(rec.p, out);
     srec.is_specular = true;
     srec.attenuation = albedo->get_color(rec.uv);
-    srec.brdf_pdf = nullptr;
     return true;
 }
 
-bool dielectric::scatter(const ray& r, const hit_record& rec, scatter_record& srec) const
+bool dielectric::scatter(const ray& r, const hit_record& rec, scatter_record& srec, sampler& s) const
 {
     double refract_ratio = rec.front_face ? (1.0 / index) : index;
 
@@ -55,7 +53,7 @@ bool dielectric::scatter(const ray& r, const hit_record& rec, scatter_record& sr
     double sine_theta_prime = dot(out_perpendicular, out_perpendicular);
 
     ray scattered;
-    if(sine_theta_prime > 1.0 || reflectance(cosine_theta, refract_ratio) > random_double())          // reflect
+    if(sine_theta_prime > 1.0 || reflectance(cosine_theta, refract_ratio) > s.get_1d())          // reflect
         scattered = ray(rec.p, rdir + normal * (cosine_theta * 2));
     else        // refract
     {
@@ -66,7 +64,6 @@ bool dielectric::scatter(const ray& r, const hit_record& rec, scatter_record& sr
     srec.specular_ray = scattered;
     srec.is_specular = true;
     srec.attenuation = color(1.0, 1.0, 1.0);
-    srec.brdf_pdf = nullptr;
 
     return true;
 }
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+
+// 64-bit finalizer (splitmix64), every input bit affects every output bit
+inline uint64_t mix_bits(uint64_t v)
+{
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+inline uint64_t hash_combine(uint64_t h, uint64_t v)
+{
+    return mix_bits(h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+/*
+    PCG32 (O'Neill), 64-bit state, 32-bit output
+    every odd increment selects an independent stream
+*/
+class pcg32
+{
+private:
+    uint64_t state;
+    uint64_t inc;
+
+    static const uint64_t mult = 0x5851f42d4c957f2dULL;
+
+    static inline uint32_t output(uint64_t old)
+    {
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    }
+
+    // multiplier and increment of the LCG advanced by delta steps
+    void jump(uint64_t delta, uint64_t& acc_mult, uint64_t& acc_plus) const
+    {
+        uint64_t cur_mult = mult, cur_plus = inc;
+        acc_mult = 1u, acc_plus = 0u;
+        while(delta > 0)
+        {
+            if(delta & 1)
+            {
+                acc_mult *= cur_mult;
+                acc_plus = acc_plus * cur_mult + cur_plus;
+            }
+            cur_plus = (cur_mult + 1) * cur_plus;
+            cur_mult *= cur_mult;
+            delta /= 2;
+        }
+    }
+
+public:
+    pcg32() : state(0x853c49e6748fea9bULL), inc(0xda3e39cb94b95bdbULL) {}
+    pcg32(uint64_t _seed, uint64_t _stream = 1) { seed(_seed, _stream); }
+
+    void seed(uint64_t _seed, uint64_t _stream = 1)
+    {
+        state = 0u;
+        inc = (_stream << 1u) | 1u;
+        next_uint();
+        state += _seed;
+        next_uint();
+    }
+
+    inline uint32_t next_uint()
+    {
+        uint64_t old = state;
+        state = old * mult + inc;
+        return output(old);
+    }
+
+    // [0, bound), unbiased (Lemire)
+    inline uint32_t next_uint(uint32_t bound)
+    {
+        uint64_t m = (uint64_t)next_uint() * bound;
+        uint32_t l = (uint32_t)m;
+        if(l < bound)
+        {
+            uint32_t t = (~bound + 1u) % bound;
+            while(l < t)
+            {
+                m = (uint64_t)next_uint() * bound;
+                l = (uint32_t)m;
+            }
+        }
+        return (uint32_t)(m >> 32);
+    }
+
+    // [0, 1)
+    inline double next_double()
+    {
+        return next_uint() * 0x1p-32;
+    }
+
+    void advance(uint64_t delta)
+    {
+        uint64_t acc_mult, acc_plus;
+        jump(delta, acc_mult, acc_plus);
+        state = acc_mult * state + acc_plus;
+    }
+
+    /*
+        same values as n calls of next_double()
+        8 lanes step the LCG 8 states at a time, so the inner loops have no dependency and vectorize
+    */
+    void fill(double* out, int n)
+    {
+        const int lanes = 8;
+        int blocks = n / lanes;
+
+        if(blocks > 0)
+        {
+            uint64_t s[lanes];
+            s[0] = state;
+            for(int k = 1; k < lanes; ++k)
+                s[k] = s[k - 1] * mult + inc;
+
+            uint64_t m8, p8;
+            jump(lanes, m8, p8);
+
+            for(int b = 0; b < blocks; ++b)
+            {
+                double* o = out + b * lanes;
+                for(int k = 0; k < lanes; ++k)
+                    o[k] = output(s[k]) * 0x1p-32;
+                for(int k = 0; k < lanes; ++k)
+                    s[k] = s[k] * m8 + p8;
+            }
+            state = s[0];
+        }
+
+        for(int i = blocks * lanes; i < n; ++i)
+            out[i] = next_double();
+    }
+};
\ No newline at end of file
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <istream>
 #include <limits>
 #include <memory>
-#include <random>
-#include <time.h>
+#include <ostream>
 #include "vector.hpp"
+#include "rng.hpp"
 
 const double INF = std::numeric_limits<double>::infinity();
 const double PI = std::acos(-1);
@@ -28,13 +30,45 @@ inline T myclamp(T x, T x_min, T x_max)
     return x;
 }
 
+// a trivially copyable value as its raw native-endian bytes
+template <class T>
+inline void write_raw(std::ostream& out, const T& v)
+{
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <class T>
+inline bool read_raw(std::istream& in, T& v)
+{
+    return (bool)in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+// 10 bits of x, y and z interleaved into a 30-bit Morton code
+inline uint32_t morton_3d(uint32_t x, uint32_t y, uint32_t z)
+{
+    auto spread = [](uint32_t v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+// per-thread generator for code outside the render loop (scene setup, tests)
+inline pcg32& thread_rng()
+{
+    static std::atomic<uint64_t> streams(0);
+    static thread_local pcg32 rng(0x2545f4914f6cdd1dULL, streams++);
+    return rng;
+}
+
 // [0, 1)
 inline double random_double()
 {
-    static std::uniform_real_distribution<double> dis(0.0, 1.0);
-    static std::default_random_engine e(time(NULL));
-
-    return dis(e);
+    return thread_rng().next_double();
 }
 
 // [min, max)
@@ -46,9 +80,7 @@ inline double random_double(double min, double max)
 // [min, max]
 inline int random_int(int min, int max)
 {
-    // can not declare static when using "uniform_int_distribution"
-    double t = static_cast<int>(random_double(min, max + 1));
-    return t;
+    return min + (int)thread_rng().next_uint(max - min + 1);
 }
 
 // [0, 1)
@@ -91,6 +123,21 @@ inline vec3<double> random_hemisphere_surface(const vec3<double>& up)
     return p;
 }
 
+// [0, 1)^2 to unit sphere surface, uniform
+inline vec3<double> sample_sphere_surface(const vec2<double>& u)
+{
+    double z = 1 - 2 * u.x;
+    double r = sqrt(fmax(0.0, 1 - z * z));
+    double phi = 2 * PI * u.y;
+    return vec3<double>(r * cos(phi), r * sin(phi), z);
+}
+
+// [0, 1)^3 to unit ball, uniform
+inline vec3<double> sample_sphere(const vec2<double>& u, double u2)
+{
+    return sample_sphere_surface(u) * cbrt(u2);
+}
+
 // Square [-1, 1] to Unit Disk r <= 1
 inline vec2<double> square_to_disk(const vec2<double>& square)
 {
@@ -140,4 +187,15 @@ inline vec3<double> disk_to_hemisphere(const vec2<double>& disk)
     double rr = sqrt(1 - z * z) / r;
 
     return vec3<double>(disk.x * rr, disk.y * rr, z);
+}
+
+// Unit Hemisphere, up = (0, 0, 1), to Unit Disk r <= 1, inverse of disk_to_hemisphere
+inline vec2<double> hemisphere_to_disk(const vec3<double>& h)
+{
+    double s = sqrt(h.x * h.x + h.y * h.y);
+    if(s <= 0)
+        return vec2<double>(0.0, 0.0);
+
+    double r = sqrt(fmax(0.0, 1 - h.z)) / s;
+    return vec2<double>(h.x * r, h.y * r);
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+    hardware cache-miss counter of this process (Linux perf events, user space only)
+    threads created after the counter inherit it, so open it before the thread pool
+    valid() is false when perf events are unavailable, then every read is 0
+*/
+class perf_counter
+{
+private:
+    int fd;
+
+public:
+    perf_counter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~perf_counter()
+    {
+#ifdef __linux__
+        if(fd >= 0) close(fd);
+#endif
+    }
+    perf_counter(const perf_counter&) = delete;
+    perf_counter& operator=(const perf_counter&) = delete;
+
+    inline bool valid() const { return fd >= 0; }
+
+    inline void start()
+    {
+#ifdef __linux__
+        if(fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    inline void stop()
+    {
+#ifdef __linux__
+        if(fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // misses counted while started, summed over the inherited threads
+    inline uint64_t read() const
+    {
+        uint64_t v = 0;
+#ifdef __linux__
+        if(fd >= 0 && ::read(fd, &v, sizeof(v)) != sizeof(v)) v = 0;
+#endif
+        return v;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/*
+    bounded lock-free queue of one producer thread and one consumer thread
+    head and tail only grow, slot i is i & mask, each sits on its own cache line so the two
+    sides do not share one; a push into a full ring drops the item and counts it
+*/
+template <class T>
+class spsc_ring
+{
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head;       // next to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail;       // next to push, written by the producer
+    std::atomic<long long> drops;               // written by the producer
+    std::atomic<size_t> peak;                   // deepest the producer saw it
+
+public:
+    // capacity rounds up to a power of 2
+    spsc_ring(int _capacity = 1 << 16) : head(0), tail(0), drops(0), peak(0)
+    {
+        size_t c = 1;
+        while(c < (size_t)_capacity)
+            c <<= 1;
+        slots.resize(c);
+        mask = c - 1;
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer side, false when the ring was full and v was dropped
+    bool push(const T& v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t d = t - head.load(std::memory_order_acquire);
+        if(d == slots.size())
+        {
+            drops.store(drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        slots[t & mask] = v;
+        tail.store(t + 1, std::memory_order_release);
+        if(d + 1 > peak.load(std::memory_order_relaxed))
+            peak.store(d + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // consumer side, f(const T&) for everything pushed so far, returns how many
+    template <class F>
+    size_t drain(F&& f)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        for(size_t i = h; i != t; ++i)
+            f(slots[i & mask]);
+        head.store(t, std::memory_order_release);
+        return t - h;
+    }
+
+    // from any thread, a moment's view
+    inline size_t capacity() const { return slots.size(); }
+    inline size_t depth() const
+    {
+        size_t h = head.load(std::memory_order_acquire);     // first, tail can only be past it
+        return tail.load(std::memory_order_acquire) - h;
+    }
+    inline size_t max_depth() const { return peak.load(std::memory_order_relaxed); }
+    inline long long dropped() const { return drops.load(std::memory_order_relaxed); }
+};
\ No newline at end of file
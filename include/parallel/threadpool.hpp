@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    persistent workers, each owning a deque of task indices
+    a worker pops from the front of its own deque and steals from the back of the others
+*/
+class thread_pool
+{
+private:
+    struct alignas(64) worker_queue
+    {
+        std::mutex m;
+        std::deque<int> tasks;
+    };
+
+    int nthread;
+    std::vector<std::thread> workers;
+    std::unique_ptr<worker_queue[]> queues;
+
+    std::function<void(int, int)> job;      // (task, thread id)
+    std::mutex m;
+    std::condition_variable cv_start, cv_done;
+    long long generation;
+    int running;
+    bool stop;
+
+    bool pop(int id, int& task);
+    bool steal(int id, int& task);
+    void worker_loop(int id);
+
+public:
+    thread_pool(int _n = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    inline int size() const { return nthread; }
+
+    // run f(task, thread id) for task in [0, n), tasks are dealt out in contiguous blocks
+    void parallel_for(int n, const std::function<void(int, int)>& f);
+};
+
+#include "threadpool.inl"
\ No newline at end of file
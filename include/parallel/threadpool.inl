@@ -0,0 +1,101 @@
+#include "threadpool.hpp"
+
+thread_pool::thread_pool(int _n) : generation(0), running(0), stop(false)
+{
+    nthread = _n > 0 ? _n : (int)std::thread::hardware_concurrency();
+    if(nthread <= 0) nthread = 1;
+
+    queues.reset(new worker_queue[nthread]);
+    for(int i = 0; i < nthread; ++i)
+        workers.emplace_back(&thread_pool::worker_loop, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+    }
+    cv_start.notify_all();
+
+    for(auto& w : workers)
+        w.join();
+}
+
+bool thread_pool::pop(int id, int& task)
+{
+    worker_queue& q = queues[id];
+    std::lock_guard<std::mutex> lock(q.m);
+    if(q.tasks.empty())
+        return false;
+
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+bool thread_pool::steal(int id, int& task)
+{
+    for(int i = 1; i < nthread; ++i)
+    {
+        worker_queue& q = queues[(id + i) % nthread];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(q.tasks.empty())
+            continue;
+
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void thread_pool::worker_loop(int id)
+{
+    long long seen = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv_start.wait(lock, [&] { return stop || generation != seen; });
+            if(stop) return;
+            seen = generation;
+        }
+
+        int task;
+        while(pop(id, task) || steal(id, task))
+            job(task, id);
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if(--running == 0)
+                cv_done.notify_all();
+        }
+    }
+}
+
+void thread_pool::parallel_for(int n, const std::function<void(int, int)>& f)
+{
+    if(n <= 0) return;
+
+    job = f;
+
+    // contiguous blocks keep neighbouring tasks (e.g. tiles along a curve) on the same worker
+    for(int i = 0; i < nthread; ++i)
+    {
+        int start = (int)((long long)n * i / nthread);
+        int end = (int)((long long)n * (i + 1) / nthread);
+
+        std::lock_guard<std::mutex> lock(queues[i].m);
+        for(int t = start; t < end; ++t)
+            queues[i].tasks.push_back(t);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m);
+        running = nthread;
+        generation++;
+        cv_start.notify_all();
+        cv_done.wait(lock, [&] { return running == 0; });
+    }
+}
\ No newline at end of file
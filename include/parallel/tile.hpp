@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "math/vector.hpp"
+#include "camera/framebuffer.hpp"
+#include "sampler/sampler.hpp"
+#include "threadpool.hpp"
+
+class tile
+{
+public:
+    int row0, row1;     // [row0, row1)
+    int col0, col1;     // [col0, col1)
+
+    tile() : row0(0), row1(0), col0(0), col1(0) {}
+    tile(int _r0, int _r1, int _c0, int _c1) : row0(_r0), row1(_r1), col0(_c0), col1(_c1) {}
+};
+
+// per-thread state handed to the pixel function, padded so threads never share a cache line
+class alignas(64) thread_context
+{
+public:
+    int id;
+    std::unique_ptr<sampler> smp;
+    long long rays;
+    long long samples;
+    int pixel;          // row * width + col of the sample being traced, -1 when the caller does not say
+
+    thread_context() : id(0), rays(0), samples(0), pixel(-1) {}
+};
+
+class render_stats
+{
+public:
+    double seconds;     // wall time
+    long long rays;
+    long long samples;
+
+    render_stats() : seconds(0.0), rays(0), samples(0) {}
+
+    inline double rays_per_second() const { return seconds > 0 ? rays / seconds : 0.0; }
+    void show() const;
+};
+
+// d-th cell of a Hilbert curve over a n x n grid, n is a power of 2
+void hilbert_d2xy(int n, int d, int& x, int& y);
+
+// tiles of a width x height image ordered along a Hilbert curve
+std::vector<tile> hilbert_tiles(int width, int height, int tile_size);
+
+/*
+    f(row, col, thread_context&) returns the pixel color
+    every tile is owned by one worker, so the framebuffer writes need no lock
+*/
+template <class F>
+render_stats render_tiles(FrameBuffer& fb, thread_pool& pool, int tile_size, F&& f, const sampler& proto = independent_sampler());
+
+#include "tile.inl"
\ No newline at end of file
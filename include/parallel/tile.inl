@@ -0,0 +1,83 @@
+#include "tile.hpp"
+
+void render_stats::show() const
+{
+    std::cout << "Time: " << seconds << "s, " << samples << " samples, " << rays << " rays, "
+              << rays_per_second() / 1e6 << " Mrays/s" << std::endl;
+}
+
+void hilbert_d2xy(int n, int d, int& x, int& y)
+{
+    x = y = 0;
+    for(int s = 1; s < n; s *= 2)
+    {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+
+        if(ry == 0)
+        {
+            if(rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+std::vector<tile> hilbert_tiles(int width, int height, int tile_size)
+{
+    int nx = (width + tile_size - 1) / tile_size;
+    int ny = (height + tile_size - 1) / tile_size;
+
+    int n = 1;
+    while(n < nx || n < ny) n *= 2;
+
+    std::vector<tile> out;
+    for(int d = 0; d < n * n; ++d)
+    {
+        int x, y;
+        hilbert_d2xy(n, d, x, y);
+        if(x >= nx || y >= ny)
+            continue;
+
+        int r0 = y * tile_size, c0 = x * tile_size;
+        out.push_back(tile(r0, std::min(r0 + tile_size, height), c0, std::min(c0 + tile_size, width)));
+    }
+    return out;
+}
+
+template <class F>
+render_stats render_tiles(FrameBuffer& fb, thread_pool& pool, int tile_size, F&& f, const sampler& proto)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<tile> tiles = hilbert_tiles(fb.get_width(), fb.get_height(), tile_size);
+    std::vector<thread_context> ctx(pool.size());
+    for(int i = 0; i < pool.size(); ++i)
+    {
+        ctx[i].id = i;
+        ctx[i].smp = proto.clone();
+    }
+
+    pool.parallel_for(tiles.size(), [&](int t, int id) {
+        const tile& tl = tiles[t];
+        for(int i = tl.row0; i < tl.row1; ++i)
+            for(int j = tl.col0; j < tl.col1; ++j)
+                fb.set_pixel(i, j, f(i, j, ctx[id]));
+    });
+
+    render_stats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for(const auto& c : ctx)
+    {
+        stats.rays += c.rays;
+        stats.samples += c.samples;
+    }
+    return stats;
+}
\ No newline at end of file
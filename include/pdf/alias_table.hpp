@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "math/vector.hpp"
+#include "math/utility.hpp"
+
+/*
+    discrete distribution over [0, n) by Walker's alias method, built in O(n) by Vose's two worklists
+    a sample is one bin and one comparison whatever n is, and what is left of u after the comparison
+    is again uniform, so the caller can place a point inside the bin with it
+*/
+class alias_table
+{
+private:
+    std::vector<double> keep;           // probability the bin is its own sample, else its alias is
+    std::vector<int> alias;
+    std::vector<double> p;              // pmf
+
+public:
+    alias_table() {}
+    // weights >= 0, all 0 is uniform
+    alias_table(const std::vector<double>& w);
+
+    // u in [0, 1), rest gets a fresh uniform in [0, 1)
+    int sample(double u, double& rest) const;
+
+    inline int size() const { return p.size(); }
+    inline double pmf(int i) const { return p[i]; }
+};
+
+/*
+    piecewise constant density over [0, 1)^2 on a nu x nv grid of cells, f given row by row
+    the row comes from the alias table of the row sums and the column from that row's table, both
+    O(1), the leftovers of the two uniforms place the point inside the cell
+*/
+class piecewise_2d
+{
+private:
+    int nu, nv;
+    alias_table rows;
+    std::vector<alias_table> columns;   // per row
+    std::vector<double> density;        // per cell, integrates to 1 over [0, 1)^2
+
+public:
+    piecewise_2d() : nu(0), nv(0) {}
+    piecewise_2d(const std::vector<double>& f, int _nu, int _nv);
+
+    coord sample(const coord& u, double& pdf) const;
+    double pdf(const coord& uv) const;
+};
+
+#include "alias_table.inl"
\ No newline at end of file
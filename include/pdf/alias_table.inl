@@ -0,0 +1,98 @@
+alias_table::alias_table(const std::vector<double>& w)
+{
+    const int n = w.size();
+    double sum = 0.0;
+    for(double v : w)
+        sum += v;
+
+    p.resize(n);
+    for(int i = 0; i < n; ++i)
+        p[i] = sum > 0 ? w[i] / sum : 1.0 / n;
+
+    // scaled so the mean bin is 1, bins under 1 take the rest from one over 1
+    keep.resize(n);
+    alias.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for(int i = 0; i < n; ++i)
+    {
+        scaled[i] = p[i] * n;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while(!small.empty() && !large.empty())
+    {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        keep[s] = scaled[s];
+        alias[s] = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if(scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // what is left is 1 up to rounding
+    for(int i : large)
+        keep[i] = 1.0, alias[i] = i;
+    for(int i : small)
+        keep[i] = 1.0, alias[i] = i;
+}
+
+int alias_table::sample(double u, double& rest) const
+{
+    const int n = keep.size();
+    double x = u * n;
+    int i = x < n - 1 ? (int)x : n - 1;
+    double f = x - i;
+
+    if(f < keep[i])
+    {
+        rest = f / keep[i];
+        return i;
+    }
+    rest = (f - keep[i]) / (1.0 - keep[i]);
+    rest = rest < 1.0 ? rest : std::nextafter(1.0, 0.0);
+    return alias[i];
+}
+
+piecewise_2d::piecewise_2d(const std::vector<double>& f, int _nu, int _nv) : nu(_nu), nv(_nv)
+{
+    std::vector<double> sums(nv, 0.0);
+    double total = 0.0;
+    columns.reserve(nv);
+    for(int v = 0; v < nv; ++v)
+    {
+        std::vector<double> row(f.begin() + v * nu, f.begin() + (v + 1) * nu);
+        for(double x : row)
+            sums[v] += x;
+        total += sums[v];
+        columns.emplace_back(row);
+    }
+    rows = alias_table(sums);
+
+    // the density the two tables sample, so pdf always agrees with sample
+    density.resize(nu * nv);
+    for(int v = 0; v < nv; ++v)
+        for(int u = 0; u < nu; ++u)
+            density[v * nu + u] = rows.pmf(v) * columns[v].pmf(u) * nu * nv;
+}
+
+coord piecewise_2d::sample(const coord& u, double& pdf) const
+{
+    double ru, rv;
+    int v = rows.sample(u.y, rv);
+    int c = columns[v].sample(u.x, ru);
+    pdf = density[v * nu + c];
+    return coord((c + ru) / nu, (v + rv) / nv);
+}
+
+double piecewise_2d::pdf(const coord& uv) const
+{
+    int c = myclamp((int)(uv.x * nu), 0, nu - 1);
+    int v = myclamp((int)(uv.y * nv), 0, nv - 1);
+    return density[v * nu + c];
+}
\ No newline at end of file
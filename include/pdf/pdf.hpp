@@ -4,12 +4,14 @@
 #include "math/matrix.hpp"
 #include "geometry/geometry.hpp"
 #include "gmm/gmm.hpp"
+#include "gmm/vmm.hpp"
+#include "sampler/sampler.hpp"
 
 class pdf
 {
 public:
     virtual double value(const direction& dir) const = 0;
-    virtual direction generate() const = 0;
+    virtual direction generate(sampler& s) const = 0;
 };
 
 
@@ -24,7 +26,7 @@ public:
     cosine_pdf(direction _n) : normal(_n.normalize()) {}
 
     virtual double value(const direction& dir) const override;
-    virtual direction generate() const override;
+    virtual direction generate(sampler& s) const override;
 };
 
 
@@ -40,7 +42,7 @@ public:
     geometry_pdf(const point& _p, std::shared_ptr<geometry> _o) : pos(_p), object(_o) {}
 
     virtual double value(const direction& dir) const override;
-    virtual direction generate() const override;
+    virtual direction generate(sampler& s) const override;
 };
 
 
@@ -55,21 +57,65 @@ public:
     void add(std::shared_ptr<pdf> _p) { pdf_list.push_back(_p); }
 
     virtual double value(const direction& dir) const override;
-    virtual direction generate() const override;
+    virtual direction generate(sampler& s) const override;
 };
 
 
 
+/*
+    directions of the hemisphere around an axis, +x -x +y -y +z -z, from a WGMM fitted in the square
+    [-1, 1]^2: square_to_disk then disk_to_hemisphere, both area preserving, so the density over
+    solid angle is the square's times 2 / pi
+
+    the Gaussians spill over the square, a sample that lands outside is no direction at all,
+    generate returns the zero vector and the caller drops the path; value is the density of the
+    directions generate does return, it integrates to the mass inside the square, below 1
+*/
 class gmm_pdf : public pdf
 {
 private:
-    GMM model;
+    const WGMM* model;
+    int hemisphere;
+
+public:
+    gmm_pdf() : model(nullptr), hemisphere(0) {}
+    gmm_pdf(const WGMM* _m, int _h) : model(_m), hemisphere(_h) {}
+
+    inline bool valid() const { return model != nullptr; }
+
+    virtual double value(const direction& dir) const override;
+    virtual direction generate(sampler& s) const override;
+
+    // hemisphere of the axis nearest to n
+    static int nearest_hemisphere(const direction& n);
+
+    // false when dir is below the hemisphere
+    static bool to_square(const direction& dir, int h, coord& square);
+    static direction from_square(const coord& square, int h);
+};
+
+/*
+    directions from a VMM times the clamped cosine around a normal, the cosine taken as one vMF lobe
+    of kappa 2.18, so the product is a vMF mixture over the whole sphere, in closed form, that both
+    value and generate use; no warp and no Jacobian, directions below the surface just carry no light
+*/
+class vmm_pdf : public pdf
+{
+private:
+    vmf_lobe lobes[VMM::max_components];
+    double scale[VMM::max_components];     // weight * vmf_norm(kappa) of every lobe
+    int count;
 
 public:
-    gmm_pdf() {}
+    static constexpr double cosine_kappa = 2.18;
+
+    vmm_pdf() : count(0) {}
+    vmm_pdf(const VMM* _m, const direction& _n);
+
+    inline bool valid() const { return count > 0; }
 
     virtual double value(const direction& dir) const override;
-    virtual direction generate() const override;
+    virtual direction generate(sampler& s) const override;
 };
 
 #include "pdf.inl"
\ No newline at end of file
@@ -6,9 +6,9 @@ double cosine_pdf::value(const direction& dir) const
     return (cosine <= 0) ? 0 : cosine / PI;
 }
     
-direction cosine_pdf::generate() const
+direction cosine_pdf::generate(sampler& s) const
 {
-    direction dir = normal + random_sphere_surface();
+    direction dir = normal + sample_sphere_surface(s.get_2d());
     if(dir.length_square() < EPS) 
         dir = normal;
     return dir.normalize();
@@ -19,9 +19,9 @@ double geometry_pdf::value(const direction& dir) const
     return object->pdf_value(ray(pos, dir));
 }
 
-direction geometry_pdf::generate() const
+direction geometry_pdf::generate(sampler& s) const
 {
-    return object->random(pos);
+    return object->random(pos, s);
 }
 
 double mixture_pdf::value(const direction& dir) const
@@ -34,18 +34,94 @@ double mixture_pdf::value(const direction& dir) const
     return (num == 0) ? 0 : ans / num;
 }
 
-direction mixture_pdf::generate() const
+direction mixture_pdf::generate(sampler& s) const
 {
-    int k = random_int(0, pdf_list.size() - 1);
-    return pdf_list[k]->generate();
+    int k = s.get_int(0, pdf_list.size() - 1);
+    return pdf_list[k]->generate(s);
+}
+
+int gmm_pdf::nearest_hemisphere(const direction& n)
+{
+    double ax = fabs(n.x), ay = fabs(n.y), az = fabs(n.z);
+    if(ax >= ay && ax >= az)
+        return n.x >= 0 ? 0 : 1;
+    if(ay >= az)
+        return n.y >= 0 ? 2 : 3;
+    return n.z >= 0 ? 4 : 5;
+}
+
+// the axis of h is the local z, the next two axes, cyclically, are x and y
+bool gmm_pdf::to_square(const direction& dir, int h, coord& square)
+{
+    int a = h / 2;
+    double s = h % 2 ? -1.0 : 1.0;
+    direction n = dir.normalize();
+    double d[3] = { n.x, n.y, n.z };
+    vec3<double> local(d[(a + 1) % 3], d[(a + 2) % 3], s * d[a]);
+    if(local.z <= 0)
+        return false;
+
+    square = disk_to_square(hemisphere_to_disk(local));
+    return true;
+}
+
+direction gmm_pdf::from_square(const coord& square, int h)
+{
+    int a = h / 2;
+    double s = h % 2 ? -1.0 : 1.0;
+    vec2<double> disk = square_to_disk(square);
+    if(disk.length_square() <= 0)
+        disk = vec2<double>(1e-9, 0.0);
+    vec3<double> local = disk_to_hemisphere(disk);
+
+    double d[3];
+    d[(a + 1) % 3] = local.x;
+    d[(a + 2) % 3] = local.y;
+    d[a] = s * local.z;
+    return direction(d[0], d[1], d[2]);
 }
 
 double gmm_pdf::value(const direction& dir) const
 {
-    return 0.0;
+    coord square;
+    if(!model || !to_square(dir, hemisphere, square))
+        return 0.0;
+    return model->pdf(square) * (2 / PI);
+}
+
+direction gmm_pdf::generate(sampler& s) const
+{
+    double u = s.get_1d();
+    coord square = model->sample(u, s.get_2d());
+    if(fabs(square.x) > 1 || fabs(square.y) > 1)
+        return direction(0, 0, 0);
+    return from_square(square, hemisphere);
+}
+
+
+
+vmm_pdf::vmm_pdf(const VMM* _m, const direction& _n) : count(_m->size())
+{
+    _m->product(_n.normalize(), cosine_kappa, lobes);
+    for(int j = 0; j < count; ++j)
+        scale[j] = lobes[j].weight * vmf_norm(lobes[j].kappa);
+}
+
+double vmm_pdf::value(const direction& dir) const
+{
+    direction w = dir.normalize();
+    double p = 0.0;
+    for(int j = 0; j < count; ++j)
+        p += scale[j] * exp(lobes[j].kappa * (dot(lobes[j].mu, w) - 1));
+    return p;
 }
 
-direction gmm_pdf::generate() const
+direction vmm_pdf::generate(sampler& s) const
 {
-    return direction();
+    double u = s.get_1d();
+    int j = 0;
+    double c = lobes[0].weight;
+    while(j + 1 < count && u >= c)
+        c += lobes[++j].weight;
+    return lobes[j].sample(s.get_2d());
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include "math/rng.hpp"
+
+inline uint32_t reverse_bits(uint32_t v)
+{
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// [0, 1) from the 32 bits of a fixed-point fraction
+inline double bits_to_double(uint32_t v)
+{
+    return v * 0x1p-32;
+}
+
+// [0, 1) from the top 53 bits of a hash
+inline double hash_to_double(uint64_t h)
+{
+    return (h >> 11) * 0x1p-53;
+}
+
+// i-th element of a random permutation of [0, n), Kensler's cycle-walking hash
+inline uint32_t permutation_element(uint32_t i, uint32_t n, uint32_t seed)
+{
+    uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+
+    do
+    {
+        i ^= seed; i *= 0xe170893d;
+        i ^= seed >> 16; i ^= (i & w) >> 4;
+        i ^= seed >> 8; i *= 0x0929eb3f;
+        i ^= seed >> 23; i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27; i *= 0x6935fa69;
+        i ^= (i & w) >> 11; i *= 0x74dcb303;
+        i ^= (i & w) >> 2; i *= 0x9e501cc3;
+        i ^= (i & w) >> 2; i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while(i >= n);
+
+    return (i + seed) % n;
+}
+
+/*
+    nested uniform (Owen) scrambling of a 32-bit fraction (Burley 2020)
+    the hash on the reversed bits only lets a bit depend on the bits above it
+*/
+inline uint32_t owen_scramble(uint32_t v, uint32_t seed)
+{
+    v = reverse_bits(v);
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return reverse_bits(v);
+}
+
+// first two dimensions of the Sobol sequence, as 32-bit fractions
+inline uint32_t sobol_dim0(uint32_t index)
+{
+    return reverse_bits(index);
+}
+
+inline uint32_t sobol_dim1(uint32_t index)
+{
+    uint32_t v = 1u << 31, out = 0;
+    for(; index; index >>= 1, v ^= v >> 1)
+        if(index & 1) out ^= v;
+    return out;
+}
+
+const int prime_count = 64;
+const int primes[prime_count] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+    137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+    227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+};
+
+// radical inverse of index in the given base, every digit permuted by a hash of the digits below it
+inline double owen_scrambled_radical_inverse(int base, uint64_t index, uint32_t seed)
+{
+    const double inv_base = 1.0 / base;
+    double inv_base_m = 1.0;
+    uint64_t reversed = 0;
+
+    // 32 bits of precision, like the Sobol points
+    while(inv_base_m > 0x1p-32)
+    {
+        uint64_t next = index / base;
+        uint32_t digit = (uint32_t)(index - next * base);
+
+        uint32_t digit_seed = (uint32_t)mix_bits(seed ^ reversed);
+        digit = permutation_element(digit, base, digit_seed);
+
+        reversed = reversed * base + digit;
+        inv_base_m *= inv_base;
+        index = next;
+    }
+
+    double v = inv_base_m * reversed;
+    return v < 1.0 ? v : 0x1.fffffffffffffp-1;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "math/vector.hpp"
+#include "math/rng.hpp"
+#include "lowdiscrepancy.hpp"
+
+/*
+    source of the uniform numbers consumed along a path
+    one sampler per thread, passed down to materials, pdfs and geometries
+
+    dimensions are handed out in call order: get_1d takes one, get_2d takes a pair
+    every number depends only on (seed, pixel, sample index, dimension), never on the thread
+*/
+class sampler
+{
+protected:
+    uint64_t seed_value;
+    int row, col, index;
+    int dim;
+
+    // hash of (seed, pixel, dimension), shared by all samples of a pixel
+    inline uint64_t pixel_hash(int d) const
+    {
+        return hash_combine(hash_combine(hash_combine(seed_value, (uint32_t)row), (uint32_t)col), (uint32_t)d);
+    }
+
+public:
+    sampler(uint64_t _seed = 0) : seed_value(_seed), row(0), col(0), index(0), dim(0) {}
+    virtual ~sampler() {}
+
+    inline void seed(uint64_t _seed) { seed_value = _seed; }
+    inline int get_dimension() const { return dim; }
+    inline void set_dimension(int _d) { dim = _d; }
+
+    virtual void start_pixel_sample(int _row, int _col, int _index) { row = _row, col = _col, index = _index, dim = 0; }
+
+    // [0, 1)
+    virtual double get_1d() = 0;
+    virtual vec2<double> get_2d() = 0;
+
+    // [min, max]
+    inline int get_int(int min, int max)
+    {
+        int n = max - min + 1;
+        int k = (int)(get_1d() * n);
+        return min + (k < n ? k : n - 1);
+    }
+
+    // n uniforms at once, same values as n calls of get_1d()
+    virtual void fill(double* out, int n);
+
+    virtual std::unique_ptr<sampler> clone() const = 0;
+};
+
+
+
+// white noise, a hash of (seed, pixel, sample index, dimension)
+class independent_sampler : public sampler
+{
+private:
+    uint64_t base;
+
+    inline double at(uint64_t d) const { return hash_to_double(mix_bits(base + d * 0x9e3779b97f4a7c15ULL)); }
+
+public:
+    independent_sampler(uint64_t _seed = 0) : sampler(_seed), base(0) {}
+
+    virtual void start_pixel_sample(int _row, int _col, int _index) override;
+    virtual double get_1d() override { return at(dim++); }
+    virtual vec2<double> get_2d() override { double x = get_1d(); return vec2<double>(x, get_1d()); }
+    virtual void fill(double* out, int n) override;
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<independent_sampler>(*this); }
+};
+
+
+
+// jittered strata, the sample index picks a stratum through a per-pixel, per-dimension permutation
+class stratified_sampler : public sampler
+{
+private:
+    int xs, ys;
+
+public:
+    stratified_sampler(int _xs, int _ys, uint64_t _seed = 0) : sampler(_seed), xs(_xs), ys(_ys) {}
+
+    virtual double get_1d() override;
+    virtual vec2<double> get_2d() override;
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<stratified_sampler>(*this); }
+};
+
+
+
+// 2D Sobol points padded across dimensions, Owen scrambled and shuffled per pixel and dimension
+class sobol_sampler : public sampler
+{
+public:
+    sobol_sampler(uint64_t _seed = 0) : sampler(_seed) {}
+
+    virtual double get_1d() override;
+    virtual vec2<double> get_2d() override;
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<sobol_sampler>(*this); }
+};
+
+
+
+// Halton sequence, one prime per dimension, Owen scrambled per pixel
+class halton_sampler : public sampler
+{
+public:
+    halton_sampler(uint64_t _seed = 0) : sampler(_seed) {}
+
+    virtual double get_1d() override;
+    virtual vec2<double> get_2d() override;
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<halton_sampler>(*this); }
+};
+
+
+
+/*
+    one Owen-scrambled Sobol point set for the whole image, its index shuffled per dimension and
+    rotated per pixel (Cranley-Patterson)
+    by the ranks of a void-and-cluster blue noise tile, so the error of neighbouring pixels is
+    anti-correlated and looks like blue noise at low sample counts
+*/
+class blue_noise_sampler : public sampler
+{
+private:
+    static const int tile_size = 64;
+    std::shared_ptr<const std::vector<int> > ranks;     // tile_size x tile_size, every rank once
+
+    double rotation(int d) const;
+
+    // the sample index Owen-shuffled per dimension, so the dimensions of a sample are not correlated
+    uint32_t shuffled_index(int d) const;
+
+public:
+    blue_noise_sampler(uint64_t _seed = 0);
+
+    virtual double get_1d() override;
+    virtual vec2<double> get_2d() override;
+
+    virtual std::unique_ptr<sampler> clone() const override { return std::make_unique<blue_noise_sampler>(*this); }
+
+    // void-and-cluster ranking of a n x n toroidal grid
+    static std::vector<int> void_and_cluster(int n, uint64_t seed);
+};
+
+#include "sampler.inl"
\ No newline at end of file
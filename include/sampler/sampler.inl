@@ -0,0 +1,220 @@
+#include "sampler.hpp"
+
+void sampler::fill(double* out, int n)
+{
+    for(int i = 0; i < n; ++i)
+        out[i] = get_1d();
+}
+
+void independent_sampler::start_pixel_sample(int _row, int _col, int _index)
+{
+    sampler::start_pixel_sample(_row, _col, _index);
+    base = hash_combine(hash_combine(hash_combine(seed_value, (uint32_t)row), (uint32_t)col), (uint32_t)index);
+}
+
+void independent_sampler::fill(double* out, int n)
+{
+    // no dependency between iterations
+    for(int i = 0; i < n; ++i)
+        out[i] = at(dim + i);
+    dim += n;
+}
+
+double stratified_sampler::get_1d()
+{
+    uint64_t h = pixel_hash(dim++);
+    int n = xs * ys;
+    double jitter = hash_to_double(hash_combine(h, index));
+
+    // past the last stratum the samples are plain white noise
+    if(index >= n)
+        return jitter;
+
+    uint32_t stratum = permutation_element(index, n, (uint32_t)h);
+    return (stratum + jitter) / n;
+}
+
+vec2<double> stratified_sampler::get_2d()
+{
+    uint64_t h = pixel_hash(dim);
+    dim += 2;
+    int n = xs * ys;
+    uint64_t hj = hash_combine(h, index);
+    vec2<double> jitter(hash_to_double(hj), hash_to_double(mix_bits(hj)));
+
+    if(index >= n)
+        return jitter;
+
+    uint32_t stratum = permutation_element(index, n, (uint32_t)h);
+    return vec2<double>((stratum % xs + jitter.x) / xs, (stratum / xs + jitter.y) / ys);
+}
+
+double sobol_sampler::get_1d()
+{
+    uint64_t h = pixel_hash(dim++);
+    uint32_t i = owen_scramble(index, (uint32_t)h);
+    return bits_to_double(owen_scramble(sobol_dim0(i), (uint32_t)(h >> 32)));
+}
+
+vec2<double> sobol_sampler::get_2d()
+{
+    uint64_t h = pixel_hash(dim);
+    dim += 2;
+    uint64_t h2 = mix_bits(h);
+
+    // shuffling the index keeps the power-of-two prefixes stratified
+    uint32_t i = owen_scramble(index, (uint32_t)h);
+    return vec2<double>(bits_to_double(owen_scramble(sobol_dim0(i), (uint32_t)(h >> 32))),
+                        bits_to_double(owen_scramble(sobol_dim1(i), (uint32_t)h2)));
+}
+
+double halton_sampler::get_1d()
+{
+    int d = dim++;
+    uint64_t h = pixel_hash(d);
+
+    if(d >= prime_count)
+        return hash_to_double(hash_combine(h, index));
+    return owen_scrambled_radical_inverse(primes[d], index, (uint32_t)h);
+}
+
+vec2<double> halton_sampler::get_2d()
+{
+    double x = get_1d();
+    return vec2<double>(x, get_1d());
+}
+
+blue_noise_sampler::blue_noise_sampler(uint64_t _seed) : sampler(_seed)
+{
+    // every sampler shares one tile
+    static std::shared_ptr<const std::vector<int> > tile = std::make_shared<const std::vector<int> >(void_and_cluster(tile_size, 0x5eed));
+    ranks = tile;
+}
+
+double blue_noise_sampler::rotation(int d) const
+{
+    // a different toroidal offset of the tile for every dimension
+    uint64_t h = hash_combine(seed_value, (uint32_t)d);
+    int x = (col + (int)(h % tile_size)) % tile_size;
+    int y = (row + (int)((h >> 32) % tile_size)) % tile_size;
+
+    return ((*ranks)[y * tile_size + x] + 0.5) / (tile_size * tile_size);
+}
+
+uint32_t blue_noise_sampler::shuffled_index(int d) const
+{
+    // the same for every pixel, so the rotations still decorrelate neighbours at each index
+    return owen_scramble(index, (uint32_t)hash_combine(seed_value, (uint32_t)d + 0x20000u));
+}
+
+double blue_noise_sampler::get_1d()
+{
+    int d = dim++;
+    uint64_t h = hash_combine(seed_value, (uint32_t)d + 0x10000u);
+
+    double v = bits_to_double(owen_scramble(sobol_dim0(shuffled_index(d)), (uint32_t)h)) + rotation(d);
+    return v < 1.0 ? v : v - 1.0;
+}
+
+vec2<double> blue_noise_sampler::get_2d()
+{
+    int d = dim;
+    dim += 2;
+    uint64_t h = hash_combine(seed_value, (uint32_t)d + 0x10000u);
+
+    // one shuffle for the pair keeps its 2D stratification
+    uint32_t i = shuffled_index(d);
+    double x = bits_to_double(owen_scramble(sobol_dim0(i), (uint32_t)h)) + rotation(d);
+    double y = bits_to_double(owen_scramble(sobol_dim1(i), (uint32_t)(h >> 32))) + rotation(d + 1);
+    return vec2<double>(x < 1.0 ? x : x - 1.0, y < 1.0 ? y : y - 1.0);
+}
+
+std::vector<int> blue_noise_sampler::void_and_cluster(int n, uint64_t seed)
+{
+    const int N = n * n;
+    const double sigma = 1.5;
+
+    // gaussian energy of a point, on a torus
+    std::vector<double> kernel(N);
+    for(int y = 0; y < n; ++y)
+        for(int x = 0; x < n; ++x)
+        {
+            int dx = x < n - x ? x : n - x;
+            int dy = y < n - y ? y : n - y;
+            kernel[y * n + x] = exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+        }
+
+    std::vector<double> energy(N, 0.0);
+    std::vector<char> bits(N, 0);
+
+    auto splat = [&](std::vector<double>& e, int p, double sign) {
+        int px = p % n, py = p / n;
+        for(int y = 0; y < n; ++y)
+            for(int x = 0; x < n; ++x)
+            {
+                int dx = (x - px + n) % n, dy = (y - py + n) % n;
+                e[y * n + x] += sign * kernel[dy * n + dx];
+            }
+    };
+    auto tightest_cluster = [&](const std::vector<double>& e, const std::vector<char>& b) {
+        int best = -1;
+        for(int i = 0; i < N; ++i)
+            if(b[i] && (best < 0 || e[i] > e[best])) best = i;
+        return best;
+    };
+    auto largest_void = [&](const std::vector<double>& e, const std::vector<char>& b) {
+        int best = -1;
+        for(int i = 0; i < N; ++i)
+            if(!b[i] && (best < 0 || e[i] < e[best])) best = i;
+        return best;
+    };
+
+    // initial pattern, then swap clusters into voids until it is stable
+    pcg32 rng(seed);
+    int ones = 0;
+    while(ones < N / 10)
+    {
+        int p = rng.next_uint(N);
+        if(bits[p]) continue;
+        bits[p] = 1;
+        splat(energy, p, 1.0);
+        ones++;
+    }
+
+    for(int iter = 0; iter < N; ++iter)
+    {
+        int c = tightest_cluster(energy, bits);
+        bits[c] = 0;
+        splat(energy, c, -1.0);
+
+        int v = largest_void(energy, bits);
+        bits[v] = 1;
+        splat(energy, v, 1.0);
+
+        if(v == c) break;
+    }
+
+    std::vector<int> rank(N, 0);
+
+    // ranks below the initial count: remove the tightest clusters one by one
+    std::vector<double> e1 = energy;
+    std::vector<char> b1 = bits;
+    for(int r = ones - 1; r >= 0; --r)
+    {
+        int c = tightest_cluster(e1, b1);
+        b1[c] = 0;
+        splat(e1, c, -1.0);
+        rank[c] = r;
+    }
+
+    // the rest: fill the largest voids
+    for(int r = ones; r < N; ++r)
+    {
+        int v = largest_void(energy, bits);
+        bits[v] = 1;
+        splat(energy, v, 1.0);
+        rank[v] = r;
+    }
+
+    return rank;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <typeinfo>
+#include "camera/camera.hpp"
+#include "geometry/geometry.hpp"
+#include "geometry/bvhnode.hpp"
+
+class scene
+{
+public:
+    Camera camera;
+    geometry_list objects;
+    BVHnode world;
+    std::shared_ptr<geometry_list> lights;
+
+    scene() : lights(std::make_shared<geometry_list>()) {}
+
+    void add(std::shared_ptr<geometry> _o) { objects.add(_o); }
+    void add_light(std::shared_ptr<geometry> _l) { objects.add(_l); lights->add(_l); }
+    // a light at infinity, only sampled and seen by rays that hit nothing, never in the BVH
+    void add_environment(std::shared_ptr<geometry> _e) { lights->add(_e); }
+
+    // call once every object is added
+    void build() { world = BVHnode(objects); }
+
+    /*
+        fingerprint of the scene light transport sees: type, bounds and area of every object, in
+        order, and which of them are lights; the camera is left out, so are materials and textures,
+        a caller that changes only those passes a salt of its own
+    */
+    uint64_t hash(uint64_t salt = 0) const
+    {
+        auto bits = [](double v) { uint64_t b; std::memcpy(&b, &v, 8); return b; };
+        uint64_t h = mix_bits(salt);
+        for(const geometry_list* list : { &objects, (const geometry_list*)lights.get() })
+        {
+            h = hash_combine(h, list->objects.size());
+            for(const auto& o : list->objects)
+            {
+                for(const char* c = typeid(*o).name(); *c; ++c)
+                    h = hash_combine(h, (unsigned char)*c);
+                AABB b = o->bounding_box();
+                for(double v : { (double)b.minimum.x, b.minimum.y, b.minimum.z, b.maximum.x, b.maximum.y, b.maximum.z, o->area() })
+                    h = hash_combine(h, bits(v));
+            }
+        }
+        return h;
+    }
+};
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <chrono>
 #include "geometry/geometry.hpp"
 #include "geometry/bvhnode.hpp"
 #include "math/ray.hpp"
@@ -7,42 +8,44 @@
 #include "camera/framebuffer.hpp"
 #include "camera/camera.hpp"
 #include "pdf/pdf.hpp"
+#include "parallel/tile.hpp"
 
 using std::make_shared;
 using std::shared_ptr;
 
 const double RR = 0.6;
 
-inline color ray_color(const ray& r, const BVHnode& world, const shared_ptr<geometry>& light, int depth)
+inline color ray_color(const ray& r, const BVHnode& world, const shared_ptr<geometry>& light, int depth, thread_context& ctx)
 {
     static const color background(0, 0, 0);
 
     if(depth <= 0) return color(0, 0, 0);
 
     hit_record rec;
+    ctx.rays++;
     if(!world.hit(r, rec))
         return background;
 
     color emit = rec.hit_mat->emitted(rec.uv);
 
     scatter_record srec;
-    if(!rec.hit_mat->scatter(r, rec, srec))
+    if(!rec.hit_mat->scatter(r, rec, srec, *ctx.smp))
         return emit;
 
     if(srec.is_specular)
-        return emit + srec.attenuation * ray_color(srec.specular_ray, world, light, depth - 1);
+        return emit + srec.attenuation * ray_color(srec.specular_ray, world, light, depth - 1, ctx);
 
-    if(random_double() > RR)
+    if(ctx.smp->get_1d() > RR)
         return emit;
 
     mixture_pdf mp;
     mp.add(make_shared<geometry_pdf>(rec.p, light));
-    mp.add(srec.brdf_pdf);
+    mp.add(make_shared<cosine_pdf>(srec.brdf_pdf));
     
-    ray scattered = ray(rec.p, mp.generate());
+    ray scattered = ray(rec.p, mp.generate(*ctx.smp));
     double pdf_val = mp.value(scattered.get_dir());
 
-    return emit + srec.attenuation * ray_color(scattered, world, light, depth - 1) * rec.hit_mat->brdf_cos(r, rec, scattered) / pdf_val / RR;
+    return emit + srec.attenuation * ray_color(scattered, world, light, depth - 1, ctx) * rec.hit_mat->brdf_cos(r, rec, scattered) / pdf_val / RR;
 }
 
 void cornell_box()
@@ -92,35 +95,42 @@ void cornell_box()
 
     BVHnode bvh(world);
 
-    for(int i = 0; i < height; ++i)
-        for(int j = 0; j < width; ++j)
+    thread_pool pool;
+
+    render_stats stats = render_tiles(fb, pool, 16, [&](int i, int j, thread_context& ctx) {
+        color result(0, 0, 0);
+        for(int k = 0; k < sample_per_pixel; ++k)
         {
-            color result(0, 0, 0);
-            for(int k = 0; k < sample_per_pixel; ++k)
-            {
-                double u = (i + random_double()) / height;
-                double v = (j + random_double()) / width;
+            ctx.smp->start_pixel_sample(i, j, k);
 
-                ray r = mycamera.get_ray(v, u);
-                color rc = ray_color(r, bvh, lights, max_depth);
+            coord jitter = ctx.smp->get_2d();
+            double u = (i + jitter.x) / height;
+            double v = (j + jitter.y) / width;
 
-                result = result + rc;
-            }
+            ray r = mycamera.get_ray(v, u);
+            color rc = ray_color(r, bvh, lights, max_depth, ctx);
 
-            fb.set_pixel(i, j, result / sample_per_pixel);
+            result = result + rc;
         }
+        ctx.samples += sample_per_pixel;
+
+        return result / sample_per_pixel;
+    });
+
+    std::cout << pool.size() << " threads. ";
+    stats.show();
 
     fb.output("./images/test.ppm");
 }
 
 int main()
 {
-    clock_t start = clock();
+    auto start = std::chrono::steady_clock::now();
 
     cornell_box();
 
-    clock_t end = clock();
-    std::cout << (double)(end - start) / CLOCKS_PER_SEC << std::endl;
+    auto end = std::chrono::steady_clock::now();
+    std::cout << std::chrono::duration<double>(end - start).count() << std::endl;
 
     return 0;
 }
\ No newline at end of file
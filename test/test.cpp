@@ -1,5 +1,8 @@
 #include <iostream>
+#include <random>
 #include <time.h>
+#include <chrono>
+#include <algorithm>
 #include "math/vector.hpp"
 #include "math/matrix.hpp"
 #include "camera/framebuffer.hpp"
@@ -8,7 +11,15 @@
 #include "material/material.hpp"
 #include "geometry/bvhnode.hpp"
 #include "kdtree/kdTree.hpp"
+#include "kdtree/photon_map.hpp"
+#include "kdtree/kd_forest.hpp"
+#include "kdtree/hash_grid.hpp"
+#include "parallel/spsc_ring.hpp"
 #include "gmm/gmm.hpp"
+#include "pdf/pdf.hpp"
+#include "pdf/alias_table.hpp"
+#include "geometry/environment.hpp"
+#include "math/rng.hpp"
 
 using namespace std;
 
@@ -187,6 +198,213 @@ void WGMM_test()
              << muC << std::endl << sigmaC << std::endl;
 }
 
+// EM throughput of WGMM, offline, one sample at a time and in batches, and the fit it ends with
+void gmm_benchmark()
+{
+    pcg32 rng(7, 11);
+    auto draw = [&](double& x, double& y, double& w) {
+        double u = rng.next_double(), a = rng.next_double(), b = rng.next_double();
+        double r = sqrt(-2 * log(1 - a)), g0 = r * cos(2 * PI * b), g1 = r * sin(2 * PI * b);
+        if(u < 0.3)
+            x = -0.5 + 0.1 * g0, y = 0.4 + 0.05 * g1;
+        else if(u < 0.7)
+            x = 0.3 + 0.2 * g0, y = -0.2 + 0.1 * g0 + 0.1 * g1;
+        else
+            x = 2 * rng.next_double() - 1, y = 2 * rng.next_double() - 1;
+        w = 0.5 + rng.next_double();
+    };
+
+    const int n = 20000, m = 200000, batch = 32;
+    std::vector<double> x(m), y(m), w(m);
+    for(int i = 0; i < m; ++i)
+        draw(x[i], y[i], w[i]);
+
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto seconds = [](auto a, auto b) { return std::chrono::duration<double>(b - a).count(); };
+    auto loglik = [&](const WGMM& g) {
+        double s = 0.0, px, py, pw;
+        for(int i = 0; i < 100000; ++i)
+            draw(px, py, pw), s += log(g.pdf(vec2<double>(px, py)));
+        return s / 100000;
+    };
+
+    WGMM a(8);
+    auto t0 = now();
+    a.offline_trainModel(x.data(), y.data(), w.data(), n);
+    auto t1 = now();
+    cout << "offline " << n / seconds(t0, t1) << " samples/s, loglik " << loglik(a) << endl;
+
+    WGMM b = a;
+    t0 = now();
+    for(int i = 0; i < m; ++i)
+        b.online_trainModel(vec2<double>(x[i], y[i]), w[i]);
+    t1 = now();
+    cout << "online " << m / seconds(t0, t1) << " samples/s, loglik " << loglik(b) << endl;
+
+    WGMM c = a;
+    t0 = now();
+    for(int i = 0; i < m; i += batch)
+        c.online_trainModel(x.data() + i, y.data() + i, w.data() + i, batch);
+    t1 = now();
+    cout << "online, batches of " << batch << " " << m / seconds(t0, t1) << " samples/s, loglik " << loglik(c) << endl;
+
+    // the map-reduce E-step on all the samples, the pool must not change the model
+    thread_pool pool;
+    WGMM d(8), e(8);
+    t0 = now();
+    d.offline_trainModel(x.data(), y.data(), w.data(), m);
+    t1 = now();
+    e.offline_trainModel(x.data(), y.data(), w.data(), m, &pool);
+    auto t2 = now();
+    bool same = true;
+    for(int j = 0; j < 8; ++j)
+    {
+        vec2<double> md = d.component(j).get_miu(), me = e.component(j).get_miu();
+        same &= d.component_weight(j) == e.component_weight(j) && md.x == me.x && md.y == me.y;
+    }
+    cout << "offline " << m << " samples, serial " << m / seconds(t0, t1) << " samples/s, " << pool.size() << " threads "
+         << m / seconds(t1, t2) << " samples/s, same model: " << (same ? "YES" : "NO") << endl;
+}
+
+// VMM against the WGMM of gmm_pdf on the same incident light: fit, density and sampling cost, and the product with the cosine
+void vmm_benchmark()
+{
+    // two lobes and a floor over the upper hemisphere, +z is hemisphere 4 of gmm_pdf
+    vmf_lobe truth[3] = { { direction(0.3, 0.2, 0.93).normalize(), 60.0, 0.5 },
+                          { direction(-0.6, 0.1, 0.79).normalize(), 8.0, 0.3 },
+                          { direction(0, 0, 1), 0.0, 0.2 } };
+    pcg32 rng(5, 9);
+    auto draw = [&] {
+        while(true)
+        {
+            double u = rng.next_double();
+            int j = u < 0.5 ? 0 : u < 0.8 ? 1 : 2;
+            direction d = truth[j].sample(coord(rng.next_double(), rng.next_double()));
+            if(d.z > 0)
+                return d;
+        }
+    };
+
+    const int n = 20000, ntest = 100000, K = 8;
+    std::vector<direction> train(n), test(ntest);
+    std::vector<double> x(n), y(n), z(n), sx, sy;
+    for(int i = 0; i < n; ++i)
+    {
+        train[i] = draw();
+        x[i] = train[i].x, y[i] = train[i].y, z[i] = train[i].z;
+        coord sq;
+        gmm_pdf::to_square(train[i], 4, sq);
+        sx.push_back(sq.x), sy.push_back(sq.y);
+    }
+    for(auto& d : test)
+        d = draw();
+
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto seconds = [](auto a, auto b) { return std::chrono::duration<double>(b - a).count(); };
+
+    WGMM g(K);
+    VMM v(K);
+    auto t0 = now();
+    g.offline_trainModel(sx.data(), sy.data(), nullptr, n);
+    auto t1 = now();
+    v.offline_trainModel(x.data(), y.data(), z.data(), nullptr, n);
+    auto t2 = now();
+
+    gmm_pdf gp(&g, 4);
+    double lg = 0.0, lv = 0.0;
+    auto t3 = now();
+    for(auto& d : test)
+        lg += log(gp.value(d));
+    auto t4 = now();
+    for(auto& d : test)
+        lv += log(v.pdf(d));
+    auto t5 = now();
+
+    independent_sampler s(3);
+    double sink = 0.0;
+    auto t6 = now();
+    for(int i = 0; i < ntest; ++i)
+    {
+        s.start_pixel_sample(0, 0, i);
+        sink += gp.generate(s).x;
+    }
+    auto t7 = now();
+    for(int i = 0; i < ntest; ++i)
+    {
+        s.start_pixel_sample(0, 0, i);
+        sink += v.sample(s.get_1d(), s.get_2d()).x;
+    }
+    auto t8 = now();
+    for(int i = 0; i < ntest; ++i)
+        sink += vmm_pdf(&v, test[i]).value(test[i]);
+    auto t9 = now();
+
+    printf("mixture   fit(ms)   loglik   pdf(ns)   sample(ns)\n");
+    printf("WGMM     %8.2f  %7.4f   %7.1f   %7.1f\n", 1e3 * seconds(t0, t1), lg / ntest, 1e9 * seconds(t3, t4) / ntest, 1e9 * seconds(t6, t7) / ntest);
+    printf("VMM      %8.2f  %7.4f   %7.1f   %7.1f\n", 1e3 * seconds(t1, t2), lv / ntest, 1e9 * seconds(t4, t5) / ntest, 1e9 * seconds(t7, t8) / ntest);
+    printf("cosine product and one pdf: %.1f ns (%g)\n", 1e9 * seconds(t8, t9) / ntest, sink);
+
+    // the product integrates to 1 over the sphere, and its samples have the mean direction its density has
+    vmm_pdf p(&v, direction(0.2, -0.1, 1));
+    const int N = 1000000;
+    double integral = 0.0;
+    direction mean_value(0, 0, 0), mean_sample(0, 0, 0);
+    for(int i = 0; i < N; ++i)
+    {
+        s.start_pixel_sample(0, 0, i);
+        direction u = sample_sphere_surface(s.get_2d());
+        integral += p.value(u) * 4 * PI;
+        mean_value = mean_value + u * (p.value(u) * 4 * PI / N);
+        mean_sample = mean_sample + p.generate(s) / N;
+    }
+    cout << "product integral " << integral / N << ", mean direction " << mean_value << " sampled " << mean_sample << endl;
+}
+
+// the hemisphere warp round trips, and the guided density integrates to the share of samples inside the square
+void gmm_pdf_test()
+{
+    double err = 0.0;
+    for(int h = 0; h < 6; ++h)
+        for(int i = 0; i < 1000; ++i)
+        {
+            coord sq(2 * random_double() - 1, 2 * random_double() - 1), back;
+            direction d = gmm_pdf::from_square(sq, h);
+            if(!gmm_pdf::to_square(d, h, back))
+                err = INF;
+            err = fmax(err, (back - sq).length());
+        }
+    cout << "round trip error " << err << endl;
+
+    std::default_random_engine e;
+    std::normal_distribution<double> n(0, 0.1);
+    std::vector<vec2<double> > data;
+    std::vector<double> w;
+    for(int i = 0; i < 2000; ++i)
+    {
+        data.push_back(vec2<double>(0.5 + n(e), -0.3 + 2 * n(e)));
+        w.push_back(1.0);
+        data.push_back(vec2<double>(2 * random_double() - 1, 2 * random_double() - 1));
+        w.push_back(0.5);
+    }
+    WGMM g(4);
+    g.offline_trainModel(data, w);
+
+    gmm_pdf p(&g, 3);
+    independent_sampler s(7);
+    const int N = 1000000;
+    double integral = 0.0, inside = 0.0, support = 0.0;
+    for(int i = 0; i < N; ++i)
+    {
+        s.start_pixel_sample(0, 0, i);
+        integral += p.value(sample_sphere_surface(s.get_2d())) * 4 * PI;
+        direction d = p.generate(s);
+        if(d.length_square() > 0)
+            inside += 1.0, support += 1.0 / p.value(d);
+    }
+    cout << "integral " << integral / N << " inside " << inside / N << endl;
+    cout << "E[1 / pdf] " << support / N << " (2 pi = " << 2 * PI << ")" << endl;
+}
+
 void kdtree_test()
 {
     point p(-1, -5, 0.0);
@@ -207,36 +425,349 @@ void kdtree_test()
         point(14.63, -0.35, 0.0)
     };
 
-    // kdTree* tree = new kdTree(data);
-    kdTree* tree = new kdTree(data[0], AXIS::AXIS_X);
-    for(int i = 1; i < data.size(); ++i)
-        tree->insert(data[i]);
-
-    auto out = tree->knn(3, p);
+    kdTree<point> tree(data);
 
-    for(int i = 0; i < out.size(); ++i)
-        std::cout << out[i] << std::endl;
+    kd_neighbor out[3];
+    int n = tree.knn(p, 3, out);
 
-    delete tree;
+    for(int i = 0; i < n; ++i)
+        std::cout << tree[out[i].index] << std::endl;
 }
 
 void kdtree_test2()
 {
     std::vector<point> p;
+    pcg32 rng(3, 5);
 
     for(int i = 0; i < 1000000; ++i)
-        p.push_back(point(random_double(0, 1), random_double(0, 1), random_double(0, 1)) * 10);
+        p.push_back(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10);
+
+    thread_pool pool;
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto seconds = [](auto a, auto b) { return std::chrono::duration<double>(b - a).count(); };
+
+    auto t0 = now();
+    kdTree<point> serial(p);
+    auto t1 = now();
+    kdTree<point> tree(p, &pool);
+    auto t2 = now();
+    cout << "build serial " << seconds(t0, t1) << "s, " << pool.size() << " threads " << seconds(t1, t2) << "s" << endl;
+
+    // a few queries against brute force, then throughput
+    const int k = 5;
+    kd_neighbor out[k];
+    bool same = true;
+    for(int q = 0; q < 20; ++q)
+    {
+        point c = point(rng.next_double(), rng.next_double(), rng.next_double()) * 10;
+        int n = tree.knn(c, k, out);
+
+        std::vector<double> d;
+        for(const point& x : p)
+            d.push_back((x - c).length_square());
+        std::sort(d.begin(), d.end());
+        for(int i = 0; i < n; ++i)
+            same &= out[i].dist2 == d[i];
+        same &= n == k;
+    }
+    cout << "knn matches brute force: " << (same ? "YES" : "NO") << endl;
+
+    const int nquery = 1000000;
+    double sum = 0.0;
+    auto t3 = now();
+    for(int q = 0; q < nquery; ++q)
+    {
+        tree.knn(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10, k, out);
+        sum += out[0].dist2;
+    }
+    auto t4 = now();
+    int found = 0, idx[256];
+    for(int q = 0; q < nquery; ++q)
+        found += tree.range(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10, 0.1, idx, 256);
+    auto t5 = now();
+    cout << nquery << " knn(5) " << seconds(t3, t4) << "s, " << nquery << " range(0.1) " << seconds(t4, t5) << "s, "
+         << (double)found / nquery << " found per range (" << sum << ")" << endl;
+}
 
-    //kdTree tree(p);
-    kdTree tree(p[0], AXIS::AXIS_X);
-    for(int i = 1; i < p.size(); ++i)
-        tree.insert(p[i]);
+void kd_forest_test()
+{
+    const int nwriter = 2, nreader = 2;
+    const int batches = 500, batch_size = 1000;
+
+    kd_forest<point> forest(nreader + 1, 256);      // a slot per reader, and the last for the check after
+    std::atomic<bool> done(false);
+    std::atomic<long long> queries(0), inconsistent(0);
+
+    // every batch is whole in a snapshot or absent, so a full-space range sees a multiple of batch_size
+    std::vector<std::thread> threads;
+    for(int w = 0; w < nwriter; ++w)
+        threads.emplace_back([&, w] {
+            pcg32 rng(11, w);
+            for(int b = 0; b < batches; ++b)
+            {
+                std::vector<point> batch;
+                for(int i = 0; i < batch_size; ++i)
+                    batch.push_back(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10);
+                forest.insert(std::move(batch));
+            }
+        });
+    for(int r = 0; r < nreader; ++r)
+        threads.emplace_back([&, r] {
+            pcg32 rng(13, r);
+            const kd_snapshot<point>* s = nullptr;
+            kd_item<point> out[8];
+            while(!done.load())
+            {
+                forest.refresh(r, s);
+                int all = 0;
+                s->range(point(5, 5, 5), 100.0, [&](const point&, double) { all++; });
+                inconsistent += all != s->size() || all % batch_size != 0;
+                for(int q = 0; q < 100; ++q)
+                    s->knn(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10, 8, out);
+                queries += 101;
+            }
+            forest.release(r);
+        });
+
+    auto start = std::chrono::steady_clock::now();
+    for(int w = 0; w < nwriter; ++w)
+        threads[w].join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    for(int r = 0; r < nreader; ++r)
+        threads[nwriter + r].join();
+
+    const kd_snapshot<point>* s = forest.snapshot(nreader);
+    cout << "kd_forest: " << s->size() << " points in " << seconds << "s, " << queries << " queries meanwhile, "
+         << s->levels.size() << " levels, " << (inconsistent == 0 ? "consistent" : "INCONSISTENT") << " snapshots" << endl;
+
+    // the final forest against brute force
+    std::vector<point> all;
+    for(const auto& level : s->levels)
+        if(level)
+            for(int i = 0; i < level->size(); ++i)
+                all.push_back((*level)[i]);
+
+    pcg32 rng(17, 0);
+    kd_item<point> out[5];
+    bool same = true;
+    for(int q = 0; q < 20; ++q)
+    {
+        point c = point(rng.next_double(), rng.next_double(), rng.next_double()) * 10;
+        int n = s->knn(c, 5, out);
+
+        std::vector<double> d;
+        for(const point& x : all)
+            d.push_back((x - c).length_square());
+        std::sort(d.begin(), d.end());
+        for(int i = 0; i < n; ++i)
+            same &= out[i].dist2 == d[i];
+        same &= n == 5;
+    }
+    cout << "forest knn matches brute force: " << (same ? "YES" : "NO") << endl;
+}
+
+// a consumer draining while a producer pushes sees every item in order, the producer retries what a full ring drops
+void spsc_ring_test()
+{
+    const long long n = 10000000;
+    spsc_ring<long long> ring(1 << 14);
+    std::atomic<bool> done(false);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        for(long long i = 0; i < n; ++i)
+            while(!ring.push(i))
+                std::this_thread::yield();
+        done = true;
+    });
+
+    long long received = 0, last = -1;
+    bool ordered = true;
+    while(true)
+    {
+        bool finished = done.load();
+        size_t got = ring.drain([&](long long v) {
+            ordered &= v > last;
+            last = v, received++;
+        });
+        if(finished)
+            break;
+        if(got == 0)
+            std::this_thread::yield();
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    cout << "spsc_ring: " << received << " of " << n << " in " << seconds << "s, " << ring.dropped() << " pushes into a full ring, peak depth "
+         << ring.max_depth() << " of " << ring.capacity() << ", " << (ordered && received == n ? "consistent" : "INCONSISTENT") << endl;
+}
+
+void environment_test()
+{
+    // every bin as often as its weight, the leftover uniform
+    std::vector<double> w { 1, 0, 3, 6, 0.5 };
+    alias_table table(w);
+    independent_sampler s(11);
+    const int n = 1000000;
+    std::vector<int> hits(w.size(), 0);
+    double rest_sum = 0.0;
+    for(int i = 0; i < n; ++i)
+    {
+        double rest;
+        hits[table.sample(s.get_1d(), rest)]++;
+        rest_sum += rest;
+    }
+    double worst = 0.0;
+    for(int i = 0; i < (int)w.size(); ++i)
+        worst = std::max(worst, std::fabs((double)hits[i] / n - table.pmf(i)));
+    cout << "alias_table: largest pmf error " << worst << ", mean leftover " << rest_sum / n << endl;
+
+    // a dim map with one bright texel: the pdf integrates to 1 and sampling by it finds the same power as uniform directions
+    const int width = 64, height = 32;
+    std::vector<color> texels(width * height, color(0.2, 0.3, 0.5));
+    texels[9 * width + 40] = color(5000, 4000, 3000);
+    environment_light env(width, height, texels);
+
+    double integral = 0.0, uniform = 0.0, sampled = 0.0;
+    for(int i = 0; i < n; ++i)
+    {
+        vec2<double> u = s.get_2d();
+        double z = 1 - 2 * u.x, r = std::sqrt(std::max(0.0, 1 - z * z)), phi = 2 * PI * u.y;
+        direction d(r * std::cos(phi), z, r * std::sin(phi));
+        integral += env.pdf_value(ray(point(0, 0, 0), d)) * 4 * PI;
+        uniform += env.environment(d).y * 4 * PI;
+
+        direction e = env.random(point(0, 0, 0), s);
+        sampled += env.environment(e).y / env.pdf_value(ray(point(0, 0, 0), e));
+    }
+    cout << "environment_light: pdf integral " << integral / n << ", power uniform " << uniform / n << ", importance sampled " << sampled / n << endl;
+}
+
+void hash_grid_test()
+{
+    const int n = 1000000, nquery = 1000000;
+    thread_pool pool;
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto seconds = [](auto a, auto b) { return std::chrono::duration<double>(b - a).count(); };
+
+    for(int clustered = 0; clustered < 2; ++clustered)
+    {
+        // uniform in a 10^3 box, or 64 tight gaussian-ish clusters inside it
+        pcg32 rng(5, clustered);
+        std::vector<point> centers;
+        for(int c = 0; c < 64; ++c)
+            centers.push_back(point(rng.next_double(), rng.next_double(), rng.next_double()) * 10);
+        auto sample = [&] {
+            if(!clustered)
+                return point(rng.next_double(), rng.next_double(), rng.next_double()) * 10;
+            point c = centers[rng.next_uint() % 64];
+            double s = 0.1 * (rng.next_double() + rng.next_double() + rng.next_double() - 1.5);
+            double t = 0.1 * (rng.next_double() + rng.next_double() + rng.next_double() - 1.5);
+            double u = 0.1 * (rng.next_double() + rng.next_double() + rng.next_double() - 1.5);
+            return c + direction(s, t, u);
+        };
+
+        std::vector<point> p, q;
+        for(int i = 0; i < n; ++i)
+            p.push_back(sample());
+        for(int i = 0; i < nquery; ++i)
+            q.push_back(sample());
+
+        // about 8 neighbours per query
+        const double r = clustered ? 0.012 : 0.124;
+        const int k = 8;
+
+        auto t0 = now();
+        kdTree<point> tree(p, &pool);
+        auto t1 = now();
+        hash_grid<point> grid(p, r, &pool);
+        auto t2 = now();
+
+        kd_neighbor nb[k];
+        int idx[1024];
+        long long found_tree = 0, found_grid = 0;
+        double sum = 0.0;
+        auto t3 = now();
+        for(const point& c : q)
+        {
+            tree.knn(c, k, nb);
+            sum += nb[0].dist2;
+        }
+        auto t4 = now();
+        for(const point& c : q)
+            found_tree += tree.range(c, r, idx, 1024);
+        auto t5 = now();
+        for(const point& c : q)
+            found_grid += grid.range(c, r, idx, 1024);
+        auto t6 = now();
+
+        bool same = found_tree == found_grid;
+        for(int i = 0; i < 20; ++i)
+        {
+            double a = 0.0, b = 0.0;
+            tree.range(q[i], r, [&](const point& x, double d2) { a += d2 + x.x; });
+            grid.range(q[i], r, [&](const point& x, double d2) { b += d2 + x.x; });
+            same &= fabs(a - b) < 1e-9;
+        }
+
+        cout << (clustered ? "clustered" : "uniform") << ": " << (double)found_grid / nquery << " found per range, "
+             << (same ? "grid matches kdTree" : "MISMATCH") << " (" << sum << ")" << endl;
+        cout << "  build   kdTree " << seconds(t0, t1) << "s   grid " << seconds(t1, t2) << "s" << endl;
+        cout << "  query   kdTree knn(" << k << ") " << seconds(t3, t4) << "s   kdTree range " << seconds(t4, t5)
+             << "s   grid range " << seconds(t5, t6) << "s" << endl;
+    }
+}
+
+void photon_map_test()
+{
+    std::vector<photon> data;
+    pcg32 rng(7, 1);
+    for(int i = 0; i < 100000; ++i)
+    {
+        // half uniform, half in a tight cluster
+        double s = i % 2 ? 10.0 : 0.5;
+        photon ph { point(rng.next_double(), rng.next_double(), rng.next_double()) * s, direction(0, 1, 0), color(i, 0, 0) };
+        data.push_back(ph);
+    }
+    photon_map map(data);
+
+    int mismatch = 0;
+    for(int q = 0; q < 200; ++q)
+    {
+        point c = point(rng.next_double(), rng.next_double(), rng.next_double()) * (q % 2 ? 10.0 : 0.5);
+        double r = q % 2 ? 0.5 : 0.02;
+
+        double sum = 0.0, brute = 0.0;
+        int n = 0, brute_n = 0;
+        map.range(c, r, [&](const photon& ph, double) { sum += ph.power.x; n++; });
+        for(const photon& ph : data)
+            if((ph.p - c).length_square() <= r * r)
+                brute += ph.power.x, brute_n++;
+        mismatch += (n != brute_n || sum != brute);
+    }
+    cout << "photon_map gather matches brute force: " << (mismatch == 0 ? "YES" : "NO") << endl;
+}
+
+void rng_test()
+{
+    const int n = 1 << 24;
+    std::vector<double> a(n), b(n);
+
+    pcg32 r1(42, 7), r2(42, 7);
+    clock_t start = clock();
+    for(int i = 0; i < n; ++i)
+        a[i] = r1.next_double();
+    clock_t mid = clock();
+    r2.fill(b.data(), n);
+    clock_t end = clock();
 
-    auto out = tree.knn(5, point(7, 2, 1));
+    bool same = (a == b) && (r1.next_uint() == r2.next_uint());
+    cout << "fill matches sequential: " << (same ? "YES" : "NO") << endl;
+    cout << "sequential " << (double)(mid - start) / CLOCKS_PER_SEC << "s, fill " << (double)(end - mid) / CLOCKS_PER_SEC << "s" << endl;
 
-    for(int i = 0; i < out.size(); ++i)
-        std::cout << out[i] << " ";
-    std::cout << std::endl;
+    pcg32 s0(42, 0), s1(42, 1);
+    cout << "streams differ: " << (s0.next_uint() != s1.next_uint() ? "YES" : "NO") << endl;
 }
 
 void rt1()
@@ -478,8 +1009,17 @@ int main()
     //geometry_test();
     // GMM_test();
     // WGMM_test();
+    // gmm_benchmark();
+    // gmm_pdf_test();
+    // vmm_benchmark();
+    environment_test();
     // kdtree_test();
-    kdtree_test2();
+    // kdtree_test2();
+    // kd_forest_test();
+    // spsc_ring_test();
+    // hash_grid_test();
+    // rng_test();
+    // photon_map_test();
 
     clock_t end = clock();
     cout << (double)(end - start) / CLOCKS_PER_SEC << endl;